@@ -0,0 +1,23 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <time.h>
+
+// every case runs for at least this long so short ones are not lost in timer noise
+#define MIN_SECONDS 1.0
+
+static inline double bench_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// one JSON object per line, so results can be appended to a log and compared over time
+static inline void bench_report(const char* name, long iterations, double seconds, const char* rate_name, double amount) {
+    printf("{\"bench\":\"%s\",\"iterations\":%ld,\"seconds\":%.3f,\"%s\":%.0f}\n",
+           name, iterations, seconds, rate_name, amount / seconds);
+    fflush(stdout);
+}
+
+#endif
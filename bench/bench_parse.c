@@ -0,0 +1,72 @@
+#include "main.h"
+#include "commands.h"
+#include "bench.h"
+
+#define LINE_BYTES (1 << 20)
+
+// repeat the given stage until the line is about LINE_BYTES long, joining stages with pipes
+char* bench_make_line(const char* stage) {
+    size_t stage_length = strlen(stage);
+    char* line = malloc(LINE_BYTES + stage_length + 4);
+    size_t length = 0;
+
+    while (length < LINE_BYTES) {
+        if (length > 0) {
+            memcpy(line + length, " | ", 3);
+            length += 3;
+        }
+        memcpy(line + length, stage, stage_length);
+        length += stage_length;
+    }
+    line[length] = '\0';
+    return line;
+}
+
+// parse the same line over and over and report how many bytes per second get through
+void bench_parse(const char* name, const char* stage) {
+    char* line = bench_make_line(stage);
+    size_t length = strlen(line);
+    long iterations = 0;
+
+    double start = bench_now();
+    double elapsed = 0;
+    while (elapsed < MIN_SECONDS) {
+        struct Job* job = turtle_parse(line);
+        if (job == NULL) {
+            fprintf(stderr, "bench_parse: %s did not parse\n", name);
+            exit(EXIT_FAILURE);
+        }
+        turtle_free_job(job);
+        iterations++;
+        elapsed = bench_now() - start;
+    }
+
+    printf("{\"bench\":\"%s\",\"bytes\":%zu,\"iterations\":%ld,\"seconds\":%.3f,\"bytes_per_sec\":%.0f}\n",
+           name, length, iterations, elapsed, length * (double) iterations / elapsed);
+    free(line);
+}
+
+// parse a typical short line over and over, the way a script hands them to the shell
+void bench_parse_lines(const char* name, const char* line) {
+    long iterations = 0;
+    double start = bench_now();
+    double elapsed = 0;
+    while (elapsed < MIN_SECONDS) {
+        for (int i = 0; i < 1000; i++) {
+            struct Job* job = turtle_parse((char*) line);
+            turtle_free_job(job);
+        }
+        iterations += 1000;
+        elapsed = bench_now() - start;
+    }
+    bench_report(name, iterations, elapsed, "lines_per_sec", iterations);
+}
+
+int main(int argc, char** argv) {
+    bench_parse("parse_plain", "command --verbose --output=some/long/path/to/a/file.txt input_one input_two");
+    bench_parse("parse_long_words", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
+    bench_parse("parse_quoted", "grep 'a single quoted pattern' \"double \\\"quoted\\\" text\" escaped\\ word < in");
+    bench_parse("parse_redirect", "sort -k2 <input.txt >output.txt");
+    bench_parse_lines("parse_short_line", "grep -v foo < input.txt | sort -u > output.txt");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,341 @@
+#include "main.h"
+#include "commands.h"
+#include "bench.h"
+
+#include <ftw.h>
+
+#define GLOB_FILES 20000
+#define TREE_DIRS 200
+#define TREE_FILES 50
+#define WIDE_DIRS (GLOB_CACHE_MAX_DIRS + 100)
+#define TABLE_JOBS 4096
+#define FAKE_PID_BASE 4000000
+#define PIPELINE_BYTES "268435456"
+#define SCRIPT_LINES 20000
+#define SCRIPT_EXTERNAL_LINES 1000
+#define HISTORY_ENTRIES 1000000
+
+char bench_dir[] = "/tmp/turtle-bench-XXXXXX";
+
+void bench_touch(const char* path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+}
+
+int bench_remove(const char* path, const struct stat* info, int flag, struct FTW* ftw) {
+    return remove(path);
+}
+
+int bench_count_match(const char* path, void* data) {
+    (*(long*) data)++;
+    return 0;
+}
+
+// one flat directory of files to match and a tree of small directories for **
+void bench_make_tree() {
+    char path[PATH_MAX];
+    if (mkdtemp(bench_dir) == NULL) {
+        perror("mkdtemp");
+        exit(EXIT_FAILURE);
+    }
+
+    snprintf(path, sizeof(path), "%s/flat", bench_dir);
+    mkdir(path, 0700);
+    for (int i = 0; i < GLOB_FILES; i++) {
+        snprintf(path, sizeof(path), "%s/flat/file_%06d.%s", bench_dir, i, i % 4 ? "txt" : "log");
+        bench_touch(path);
+    }
+
+    snprintf(path, sizeof(path), "%s/tree", bench_dir);
+    mkdir(path, 0700);
+    for (int i = 0; i < TREE_DIRS; i++) {
+        snprintf(path, sizeof(path), "%s/tree/d%03d", bench_dir, i);
+        mkdir(path, 0700);
+        snprintf(path, sizeof(path), "%s/tree/d%03d/sub", bench_dir, i);
+        mkdir(path, 0700);
+        for (int j = 0; j < TREE_FILES; j++) {
+            snprintf(path, sizeof(path), "%s/tree/d%03d/%s/f%03d.%s", bench_dir, i, j % 2 ? "sub" : ".", j, j % 3 ? "c" : "h");
+            bench_touch(path);
+        }
+    }
+
+    // more directories than the cache holds, so one expansion has to empty it partway through
+    snprintf(path, sizeof(path), "%s/wide", bench_dir);
+    mkdir(path, 0700);
+    for (int i = 0; i < WIDE_DIRS; i++) {
+        snprintf(path, sizeof(path), "%s/wide/d%04d", bench_dir, i);
+        mkdir(path, 0700);
+        snprintf(path, sizeof(path), "%s/wide/d%04d/f", bench_dir, i);
+        bench_touch(path);
+    }
+}
+
+// cold clears the directory cache before every expansion so each one reads the directories again
+void bench_glob(const char* name, const char* pattern, int cold) {
+    char full[PATH_MAX];
+    snprintf(full, sizeof(full), "%s/%s", bench_dir, pattern);
+
+    long iterations = 0, matches = 0;
+    double start = bench_now();
+    double elapsed = 0;
+    while (elapsed < MIN_SECONDS) {
+        if (cold) {
+            turtle_glob_clear();
+        }
+        turtle_glob_each(full, bench_count_match, &matches);
+        iterations++;
+        elapsed = bench_now() - start;
+    }
+    bench_report(name, iterations, elapsed, "matches_per_sec", matches);
+}
+
+// how many short-lived commands each engine can start and reap per second
+void bench_launch(const char* name, enum engine engine) {
+    enum engine saved = turtle_engine;
+    turtle_engine = engine;
+
+    long iterations = 0;
+    double start = bench_now();
+    double elapsed = 0;
+    while (elapsed < MIN_SECONDS) {
+        turtle_execute(turtle_parse("/bin/true"));
+        iterations++;
+        elapsed = bench_now() - start;
+    }
+    bench_report(name, iterations, elapsed, "launches_per_sec", iterations);
+    turtle_engine = saved;
+}
+
+// push a fixed amount of data through a chain of cats and see how fast it drains
+void bench_pipeline(int stages) {
+    char line[256] = "head -c " PIPELINE_BYTES " /dev/zero";
+    for (int i = 0; i < stages; i++) {
+        strcat(line, " | cat");
+    }
+    strcat(line, " > /dev/null");
+
+    char name[64];
+    snprintf(name, sizeof(name), "pipeline_%d_stage", stages + 1);
+
+    long iterations = 0;
+    double start = bench_now();
+    double elapsed = 0;
+    while (elapsed < MIN_SECONDS) {
+        turtle_execute(turtle_parse(line));
+        iterations++;
+        elapsed = bench_now() - start;
+    }
+    bench_report(name, iterations, elapsed, "mb_per_sec", iterations * atof(PIPELINE_BYTES) / (1 << 20));
+}
+
+// fill the job table with pipelines whose commands carry made-up pids, then look them up and tear them down
+void bench_job_table() {
+    struct Job** jobs = malloc(TABLE_JOBS * sizeof(struct Job*));
+    int* ids = malloc(TABLE_JOBS * sizeof(int));
+    double insert_time = 0, find_time = 0, remove_time = 0;
+    long rounds = 0, commands = 0;
+
+    while (insert_time + find_time + remove_time < MIN_SECONDS) {
+        pid_t pid = FAKE_PID_BASE;
+        for (int i = 0; i < TABLE_JOBS; i++) {
+            jobs[i] = turtle_parse("sleep 1 | grep x | wc -l");
+            for (struct Command* cmd = jobs[i]->root; cmd != NULL; cmd = cmd->next) {
+                cmd->pid = pid++;
+            }
+        }
+        commands = pid - FAKE_PID_BASE;
+
+        double start = bench_now();
+        for (int i = 0; i < TABLE_JOBS; i++) {
+            ids[i] = turtle_insert_job(jobs[i]);
+            for (struct Command* cmd = jobs[i]->root; cmd != NULL; cmd = cmd->next) {
+                turtle_index_pid(cmd);
+            }
+        }
+        double found = bench_now();
+        for (pid_t p = FAKE_PID_BASE; p < pid; p++) {
+            if (turtle_find_pid(p) == NULL) {
+                fprintf(stderr, "bench_runtime: pid %d went missing\n", p);
+                exit(EXIT_FAILURE);
+            }
+        }
+        double removing = bench_now();
+        for (int i = 0; i < TABLE_JOBS; i++) {
+            turtle_remove_job(ids[i]);
+        }
+        double end = bench_now();
+
+        insert_time += found - start;
+        find_time += removing - found;
+        remove_time += end - removing;
+        rounds++;
+    }
+
+    bench_report("job_table_insert", rounds * TABLE_JOBS, insert_time, "jobs_per_sec", rounds * TABLE_JOBS);
+    bench_report("job_table_find_pid", rounds * commands, find_time, "lookups_per_sec", rounds * commands);
+    bench_report("job_table_remove", rounds * TABLE_JOBS, remove_time, "jobs_per_sec", rounds * TABLE_JOBS);
+    free(jobs);
+    free(ids);
+}
+
+// a history file of commands that look like a long-lived shell's, with plenty of repeats
+void bench_make_history() {
+    const char* shapes[] = {
+        "git commit -m 'fix issue %d'", "make -j8 target_%d", "ssh build%d.example.com",
+        "grep -rn pattern_%d src/", "cd /var/log/app%d", "ls -la", "git status", "kubectl logs pod-%d",
+    };
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/history", bench_dir);
+    FILE* history = fopen(path, "w");
+    srand(1);
+    for (int i = 0; i < HISTORY_ENTRIES; i++) {
+        fprintf(history, shapes[i % 8], rand() % (HISTORY_ENTRIES / 4));
+        fputc('\n', history);
+    }
+    fclose(history);
+    setenv("TURTLE_HISTORY", path, 1);
+    turtle_history_init();
+}
+
+// look up text over and over in the trigram index of a million commands
+void bench_history_search(const char* name, const char* text) {
+    long results[HISTORY_MATCHES];
+    long iterations = 0;
+    double start = bench_now();
+    double elapsed = 0;
+    while (elapsed < MIN_SECONDS) {
+        turtle_history_search(text, results, HISTORY_MATCHES);
+        iterations++;
+        elapsed = bench_now() - start;
+    }
+    bench_report(name, iterations, elapsed, "searches_per_sec", iterations);
+}
+
+// complete a word over and over, the way tab does; paths are given relative to the bench directory
+void bench_complete(const char* name, const char* word, enum complete_kind kind) {
+    char full[PATH_MAX];
+    snprintf(full, sizeof(full), "%s/%s", bench_dir, word);
+
+    struct Completion found;
+    long iterations = 0, matches = 0;
+    double start = bench_now();
+    double elapsed = 0;
+    while (elapsed < MIN_SECONDS) {
+        turtle_complete(kind == COMPLETE_PATH ? full : word, kind, &found);
+        matches += found.count;
+        turtle_complete_free(&found);
+        iterations++;
+        elapsed = bench_now() - start;
+    }
+    bench_report(name, iterations, elapsed, "matches_per_sec", matches);
+}
+
+// build the prompt over and over, once from the cache and once asking the background thread each time
+void bench_prompt(const char* name, int background) {
+    turtle_prompt.enabled[PROMPT_BRANCH] = background;
+    turtle_prompt.enabled[PROMPT_LOAD] = background;
+    turtle_prompt.stale = 1;
+
+    long iterations = 0;
+    double start = bench_now();
+    double elapsed = 0;
+    while (elapsed < MIN_SECONDS) {
+        turtle_prompt_render();
+        iterations++;
+        elapsed = bench_now() - start;
+    }
+    bench_report(name, iterations, elapsed, "prompts_per_sec", iterations);
+}
+
+// run a whole script through the real shell binary, the way make or a CI job would
+void bench_script(const char* name, const char* command, int lines) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s.sh", bench_dir, name);
+    FILE* script = fopen(path, "w");
+    if (script == NULL) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < lines; i++) {
+        fprintf(script, "%s\n", command);
+    }
+    fclose(script);
+
+    double start = bench_now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        execl("./shell", "shell", path, (char*) NULL);
+        perror("./shell");
+        _exit(127);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    double elapsed = bench_now() - start;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) == 127) {
+        fprintf(stderr, "bench_runtime: %s did not run, build the shell first\n", name);
+        return;
+    }
+    bench_report(name, lines, elapsed, "commands_per_sec", lines);
+}
+
+int main(int argc, char** argv) {
+    turtle_init(0);
+    bench_make_tree();
+
+    // both list a directory again while a walk is still going through it: through .., which only
+    // rereads it while the tree is too new to trust, so it goes first, and by filling the cache;
+    // built with -fsanitize=address they catch a listing freed from under the walk
+    bench_glob("glob_parent_cold", "tree/d00*/../d00*", 1);
+    bench_glob("glob_evict_cold", "wide/*/*", 1);
+
+    bench_glob("glob_flat_cold", "flat/*.txt", 1);
+    bench_glob("glob_tree_cold", "tree/**/*.c", 1);
+
+    // listings taken right after a change are not trusted, so let the directories settle first
+    sleep(2);
+    bench_glob("glob_flat_warm", "flat/*.txt", 0);
+    bench_glob("glob_flat_warm_prefix", "flat/file_01*.log", 0);
+    bench_glob("glob_tree_warm", "tree/**/*.c", 0);
+
+    bench_launch("launch_fork", FORK_ENGINE);
+    bench_launch("launch_vfork", VFORK_ENGINE);
+    bench_launch("launch_spawn", SPAWN_ENGINE);
+
+    for (int stages = 0; stages <= 3; stages++) {
+        bench_pipeline(stages);
+    }
+
+    bench_job_table();
+
+    bench_make_history();
+    double index_start = bench_now();
+    turtle_history_index_build();
+    bench_report("history_index_build", HISTORY_ENTRIES, bench_now() - index_start, "entries_per_sec", HISTORY_ENTRIES);
+    bench_history_search("history_search_rare", "issue 12345'");
+    bench_history_search("history_search_common", "git");
+    bench_history_search("history_search_prefix", "ssh build99");
+
+    double trie_start = bench_now();
+    turtle_commands_refresh();
+    bench_report("complete_command_index_build", turtle_editor.commands.names, bench_now() - trie_start,
+                 "names_per_sec", turtle_editor.commands.names);
+    bench_complete("complete_command", "g", COMPLETE_COMMAND);
+    bench_complete("complete_path_prefix", "flat/file_01", COMPLETE_PATH);
+    bench_complete("complete_path_all", "flat/", COMPLETE_PATH);
+
+    bench_prompt("prompt_render_cached", 0);
+    bench_prompt("prompt_render_background", 1);
+
+    bench_script("script_builtin", "true", SCRIPT_LINES);
+    bench_script("script_echo", "echo some words to print", SCRIPT_LINES);
+    bench_script("script_external", "/bin/true", SCRIPT_EXTERNAL_LINES);
+
+    nftw(bench_dir, bench_remove, 16, FTW_DEPTH | FTW_PHYS);
+    return EXIT_SUCCESS;
+}
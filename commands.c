@@ -24,21 +24,44 @@ int turtle_cd(int argc, char** args) {
     } else {
         if(chdir(args[1]) != 0) {
             perror("turtle");
+        } else {
+            // the prompt shows shell->dir, so this is the one place it needs looking up
+            getcwd(shell->dir, sizeof(shell->dir));
+            turtle_prompt.stale = 1;
         }
     }
     return 1;
 }
 
-/* exits the shell */
-int turtle_exit() {
-    set_text(0);
-    exit(0);
+/* exits the shell with the status given, or that of the last command */
+int turtle_exit(int argc, char** argv) {
+    int status = shell->last_status;
+    if (argc > 1) {
+        char* end;
+        long value = strtol(argv[1], &end, 10);
+        if (*end != '\0' || end == argv[1]) {
+            fprintf(stderr, "turtle: exit: %s: numeric argument required\n", argv[1]);
+            return -1;
+        }
+        status = value & 0xff;
+    }
+    if (shell->interactive) {
+        set_text(0);
+    }
+    exit(status);
 }
 
-int turtle_jobs() {
-    for (int i = 0; i < MAX_NUM_JOBS; i++) {
+int turtle_jobs(int argc, char** argv) {
+    int long_format = argc > 1 && strcmp(argv[1], "-l") == 0;
+
+    // stop as soon as every job in the table has been shown
+    int shown = 0;
+    for (int i = 1; i < shell->jobs_size && shown < shell->jobs_count; i++) {
         if (shell->jobs[i] != NULL) {
-            turtle_print_job_status(i);
+            if (shell->jobs[i] != shell->current_job) {
+                turtle_print_job_status(i, long_format);
+            }
+            shown++;
         }
     }
     return 1;
@@ -56,23 +79,27 @@ int turtle_fg(int argc, char** argv) {
         return -1;
     }
 
-    tcsetpgrp(0, pid);
+    if (shell->interactive) {
+        tcsetpgrp(0, pid);
+    }
     
     // wait for the process to finish executing
     int status = 0;
-    waitpid(pid, &status, WUNTRACED);
-    if (WIFEXITED(status)) {
-        turtle_set_status(pid, DONE);
-    } else if (WIFSIGNALED(status)) {
-        turtle_set_status(pid, TERMINATED);
-    } else if (WSTOPSIG(status)) {
+    struct rusage usage;
+    wait4(pid, &status, WUNTRACED, &usage);
+    struct Command* cmd = turtle_find_pid(pid);
+    if (cmd != NULL) {
+        turtle_record_status(cmd, status, &usage);
+    }
+    if (WIFSTOPPED(status)) {
         status = -1;
-        turtle_set_status(pid, SUSPENDED);
     }
 
-    signal(SIGTTOU, SIG_IGN);
-    tcsetpgrp(0, getpid());
-    signal(SIGTTOU, SIG_DFL);
+    if (shell->interactive) {
+        signal(SIGTTOU, SIG_IGN);
+        tcsetpgrp(0, getpid());
+        signal(SIGTTOU, SIG_DFL);
+    }
 
     turtle_remove_process(pid);
 
@@ -117,9 +144,1065 @@ int turtle_unset(int argc, char** argv) {
         return -1;
     }
 
+    // a different PATH makes every remembered location stale
+    if (strcmp(argv[1], "PATH") == 0) {
+        turtle_hash_clear();
+    }
+
     return unsetenv(argv[1]);
 }
 
+/* lists, clears, or fills the table of remembered command locations */
+int turtle_hash(int argc, char** argv) {
+    // with no arguments, list everything we remember
+    if (argc < 2) {
+        int empty = 1;
+        for (int i = 0; i < HASH_SIZE; i++) {
+            struct Hash_Entry* entry = turtle_hash_table[i];
+            while (entry != NULL) {
+                if (empty) {
+                    printf("hits\tcommand\tpath\n");
+                    empty = 0;
+                }
+                printf("%4d\t%s\t%s\n", entry->hits, entry->name, entry->path);
+                entry = entry->next;
+            }
+        }
+        if (empty) {
+            printf("turtle: hash table empty\n");
+        }
+        return 1;
+    }
+
+    if (strcmp(argv[1], "-r") == 0) {
+        turtle_hash_clear();
+        return 1;
+    }
+
+    // look up each name now so later launches skip the PATH search
+    for (int i = 1; i < argc; i++) {
+        if (turtle_hash_find(argv[i], 0) == NULL) {
+            fprintf(stderr, "turtle: hash: %s: not found\n", argv[i]);
+        }
+    }
+    return 1;
+}
+
+/* shows or switches the engine used to start external commands */
+int turtle_engine_cmd(int argc, char** argv) {
+    char* names[NUM_ENGINES] = {"fork", "vfork", "spawn"};
+
+    // with no arguments, show how fast each engine has been
+    if (argc < 2) {
+        for (int i = 0; i < NUM_ENGINES; i++) {
+            long launches = turtle_engine_stats[i].launches;
+            printf("%c %-6s %8ld launches", i == turtle_engine ? '*' : ' ', names[i], launches);
+            if (launches > 0) {
+                printf("  %10.1f us avg", turtle_engine_stats[i].total_ns / 1000.0 / launches);
+            }
+            printf("\n");
+        }
+        return 1;
+    }
+
+    if (strcmp(argv[1], "-r") == 0) {
+        memset(turtle_engine_stats, 0, sizeof(turtle_engine_stats));
+        return 1;
+    }
+
+    for (int i = 0; i < NUM_ENGINES; i++) {
+        if (strcmp(argv[1], names[i]) == 0) {
+            turtle_engine = i;
+            return 1;
+        }
+    }
+
+    fprintf(stderr, "turtle: invalid engine, use fork, vfork, or spawn\n");
+    return -1;
+}
+
+/* shows how much memory the job arenas are holding */
+int turtle_arena() {
+    printf("allocations    %ld\n", turtle_arena_stats.allocations);
+    printf("live blocks    %ld\n", turtle_arena_stats.blocks_live);
+    printf("cached blocks  %ld\n", turtle_arena_stats.blocks_cached);
+    printf("block mallocs  %ld\n", turtle_arena_stats.block_mallocs);
+    printf("block frees    %ld\n", turtle_arena_stats.block_frees);
+    printf("live bytes     %lld\n", turtle_arena_stats.bytes_live);
+    printf("peak bytes     %lld\n", turtle_arena_stats.bytes_peak);
+    return 1;
+}
+
+/* shows how well the directory cache behind wildcards is working */
+int turtle_globcache(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "-r") == 0) {
+        turtle_glob_clear();
+        turtle_glob_stats.hits = 0;
+        turtle_glob_stats.misses = 0;
+        return 1;
+    }
+
+    long lookups = turtle_glob_stats.hits + turtle_glob_stats.misses;
+    printf("hits           %ld\n", turtle_glob_stats.hits);
+    printf("misses         %ld\n", turtle_glob_stats.misses);
+    printf("hit rate       %.1f%%\n", lookups > 0 ? 100.0 * turtle_glob_stats.hits / lookups : 0.0);
+    printf("directories    %ld\n", turtle_glob_stats.dirs_cached);
+    printf("names          %ld\n", turtle_glob_stats.names_cached);
+    return 1;
+}
+
+/* inspects or changes how many background jobs may run at once */
+int turtle_sched(int argc, char** argv) {
+    if (argc < 2) {
+        printf("scheduler %s, limit ", shell->sched_enabled ? "on" : "off");
+        if (shell->sched_max > 0) {
+            printf("%d", shell->sched_max);
+        } else {
+            printf("none");
+        }
+        printf(", %d running, %d queued\n", shell->sched_running, shell->sched_queued);
+
+        struct Job* job = shell->sched_head;
+        while (job != NULL) {
+            printf("[%d]\t", job->id);
+            for (int i = 0; i < job->root->argc; i++) {
+                printf("%s ", job->root->argv[i]);
+            }
+            printf("\n");
+            job = job->queue_next;
+        }
+        return 1;
+    }
+
+    if (strcmp(argv[1], "on") == 0) {
+        shell->sched_enabled = 1;
+    } else if (strcmp(argv[1], "off") == 0) {
+        // everything still waiting starts right away
+        shell->sched_enabled = 0;
+        turtle_sched_dispatch();
+    } else if (strcmp(argv[1], "-j") == 0 && argc > 2) {
+        int max = atoi(argv[2]);
+        if (max < 0) {
+            fprintf(stderr, "turtle: invalid limit for sched\n");
+            return -1;
+        }
+        shell->sched_max = max;
+        shell->sched_enabled = 1;
+        turtle_sched_dispatch();
+    } else if (strcmp(argv[1], "-c") == 0) {
+        // throw away every job that has not started yet
+        while (shell->sched_head != NULL) {
+            turtle_remove_job(shell->sched_head->id);
+        }
+    } else {
+        fprintf(stderr, "turtle: invalid argument for sched\n");
+        return -1;
+    }
+
+    return 1;
+}
+
+/* build one word of a parallel task, putting the item wherever {} appears */
+char* turtle_parallel_word(struct Arena* arena, char* word, char* item) {
+    char* marker = strstr(word, "{}");
+    if (marker == NULL) {
+        return word;
+    }
+
+    // count the markers so the word can be built in one allocation
+    int markers = 0;
+    for (char* cur = marker; cur != NULL; cur = strstr(cur + 2, "{}")) {
+        markers++;
+    }
+
+    size_t item_length = strlen(item);
+    char* result = turtle_arena_alloc(arena, strlen(word) + markers * item_length + 1);
+    char* out = result;
+    while (marker != NULL) {
+        memcpy(out, word, marker - word);
+        out += marker - word;
+        memcpy(out, item, item_length);
+        out += item_length;
+        word = marker + 2;
+        marker = strstr(word, "{}");
+    }
+    strcpy(out, word);
+    return result;
+}
+
+/* runs a command template once per item, spreading the work across cores */
+int turtle_parallel(int argc, char** argv, int in_fd, int out_fd) {
+    int max_running = sysconf(_SC_NPROCESSORS_ONLN);
+    int group_output = 0;
+    int index = 1;
+
+    // read the options that come before the command
+    while (index < argc && argv[index][0] == '-') {
+        if (strcmp(argv[index], "-j") == 0 && index + 1 < argc) {
+            max_running = atoi(argv[index + 1]);
+            index += 2;
+        } else if (strcmp(argv[index], "-g") == 0) {
+            group_output = 1;
+            index++;
+        } else {
+            break;
+        }
+    }
+
+    // the command template runs up to the ::: that starts the items
+    int template_start = index;
+    while (index < argc && strcmp(argv[index], ":::") != 0) {
+        index++;
+    }
+    int template_length = index - template_start;
+    int item_start = index + 1;
+    if (template_length == 0 || index >= argc || max_running <= 0) {
+        fprintf(stderr, "turtle: usage: parallel [-j N] [-g] command {} ::: items...\n");
+        return -1;
+    }
+
+    // every task runs the same program, so look it up once
+    char* exec_path = argv[template_start];
+    if (strchr(exec_path, '/') == NULL) {
+        exec_path = turtle_hash_lookup(exec_path);
+    }
+    if (exec_path == NULL) {
+        fprintf(stderr, "turtle could not find command: %s\n", argv[template_start]);
+        return -1;
+    }
+
+    // each item becomes one command of a single job so jobs tracks them together
+    struct Job* job = turtle_new_job();
+    job->mode_type = FOREGROUND;
+    int uses_marker = 0;
+    for (int i = template_start; i < index; i++) {
+        if (strstr(argv[i], "{}") != NULL) {
+            uses_marker = 1;
+        }
+    }
+
+    struct Command* last = NULL;
+    for (int i = item_start; i < argc; i++) {
+        int task_argc = template_length + (uses_marker ? 0 : 1);
+        struct Command* cmd = turtle_arena_alloc(&job->arena, sizeof(struct Command));
+        cmd->argv = turtle_arena_alloc(&job->arena, (task_argc + 1) * sizeof(char*));
+        for (int j = 0; j < template_length; j++) {
+            cmd->argv[j] = turtle_parallel_word(&job->arena, argv[template_start + j], argv[i]);
+        }
+        if (!uses_marker) {
+            cmd->argv[template_length] = turtle_arena_strdup(&job->arena, argv[i]);
+        }
+        cmd->argc = task_argc;
+        cmd->cmd_type = EXTERNAL;
+        cmd->pid = -1;
+        cmd->status_type = QUEUED;
+        cmd->job = job;
+
+        if (last == NULL) {
+            job->root = cmd;
+        } else {
+            last->next = cmd;
+        }
+        last = cmd;
+    }
+
+    if (job->root == NULL) {
+        turtle_free_job(job);
+        return 1;
+    }
+    turtle_insert_job(job);
+
+    struct Pool pool;
+    turtle_pool_init(&pool, job, max_running, group_output, in_fd, out_fd);
+    struct Command* cur_cmd = job->root;
+    while (cur_cmd != NULL && turtle_pool_submit(&pool, cur_cmd, exec_path) == 0) {
+        cur_cmd = cur_cmd->next;
+    }
+    turtle_pool_finish(&pool);
+
+    // report how every task ended
+    int tasks = 0, failed = 0, skipped = 0;
+    for (cur_cmd = job->root; cur_cmd != NULL; cur_cmd = cur_cmd->next) {
+        tasks++;
+        if (cur_cmd->status_type == QUEUED) {
+            skipped++;
+            continue;
+        }
+        if (cur_cmd->exit_code != 0) {
+            failed++;
+        }
+        printf("[%d]\t%d\t", job->id, cur_cmd->pid);
+        for (int i = 0; i < cur_cmd->argc; i++) {
+            printf("%s ", cur_cmd->argv[i]);
+        }
+        printf("\texit %d\n", cur_cmd->exit_code);
+    }
+    printf("parallel: %d tasks, %d succeeded, %d failed", tasks, tasks - failed - skipped, failed);
+    if (skipped > 0) {
+        printf(", %d not started", skipped);
+    }
+    printf("\n");
+
+    turtle_remove_job(job->id);
+    return 1;
+}
+
+/* start the arguments gathered so far as one batch, with the fixed arguments around them */
+void turtle_batch_flush(struct Batch* batch) {
+    struct Command* source = batch->cmd;
+    struct Job* job = batch->pool.job;
+    int before = batch->first - batch->start;
+    int after = source->argc - batch->last - 1;
+    int argc = before + batch->chunk_count + after;
+
+    // each batch owns its arguments in one allocation so they can go as soon as it finishes
+    char** argv = malloc((argc + 1) * sizeof(char*) + batch->strings_used);
+    char* strings = (char*) (argv + argc + 1);
+    memcpy(strings, batch->strings, batch->strings_used);
+
+    int position = 0;
+    for (int i = batch->start; i < batch->first; i++) {
+        argv[position++] = source->argv[i];
+    }
+    for (int i = 0; i < batch->chunk_count; i++) {
+        argv[position++] = strings;
+        strings += strlen(strings) + 1;
+    }
+    for (int i = batch->last + 1; i < source->argc; i++) {
+        argv[position++] = source->argv[i];
+    }
+    argv[position] = NULL;
+
+    struct Command* cmd = turtle_arena_alloc(&job->arena, sizeof(struct Command));
+    cmd->argv = argv;
+    cmd->argc = argc;
+    cmd->cmd_type = EXTERNAL;
+    cmd->pid = -1;
+    cmd->status_type = QUEUED;
+    cmd->job = job;
+    if (batch->tail == NULL) {
+        job->root = cmd;
+        batch->reclaim = cmd;
+    } else {
+        batch->tail->next = cmd;
+    }
+    batch->tail = cmd;
+
+    batch->strings_used = 0;
+    batch->chunk_count = 0;
+    batch->chunk_bytes = 0;
+    turtle_pool_submit(&batch->pool, cmd, batch->exec_path);
+
+    // free the arguments of batches that are done, leaving just the program name for jobs
+    while (batch->reclaim != NULL && batch->reclaim != cmd
+           && (batch->reclaim->status_type == DONE || batch->reclaim->status_type == TERMINATED)) {
+        struct Command* done = batch->reclaim;
+        char** short_argv = turtle_arena_alloc(&job->arena, 2 * sizeof(char*));
+        short_argv[0] = source->argv[batch->start];
+        free(done->argv);
+        done->argv = short_argv;
+        done->argc = 1;
+        batch->reclaim = done->next;
+    }
+}
+
+/* add one argument to the batch being gathered, starting it first if the argument will not fit */
+int turtle_batch_add(const char* arg, void* data) {
+    struct Batch* batch = data;
+    long length = strlen(arg) + 1;
+    long cost = length + sizeof(char*);
+
+    if (batch->chunk_count > 0 && batch->chunk_bytes + cost > batch->limit) {
+        turtle_batch_flush(batch);
+    }
+
+    if (batch->strings_used + length > batch->strings_size) {
+        while (batch->strings_used + length > batch->strings_size) {
+            batch->strings_size = batch->strings_size ? batch->strings_size * 2 : BUFSIZ;
+        }
+        batch->strings = realloc(batch->strings, batch->strings_size);
+    }
+    memcpy(batch->strings + batch->strings_used, arg, length);
+    batch->strings_used += length;
+    batch->chunk_count++;
+    batch->chunk_bytes += cost;
+
+    // once ctrl-c is pressed there is no point expanding any further
+    return batch->pool.interrupted;
+}
+
+/* runs a command as many times as it takes to fit its arguments into exec, like xargs;
+   every batch reads and writes wherever the command itself was pointed */
+int turtle_batch(struct Command* cmd, int in_fd, int out_fd) {
+    struct Batch batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.cmd = cmd;
+    int max_running = 1;
+
+    // with autobatch the command arrives as typed, without the batch prefix
+    if (strcmp(cmd->argv[0], "batch") == 0) {
+        batch.start = 1;
+        if (batch.start + 1 < cmd->argc && strcmp(cmd->argv[batch.start], "-j") == 0) {
+            max_running = atoi(cmd->argv[batch.start + 1]);
+            batch.start += 2;
+        }
+    }
+    if (batch.start >= cmd->argc || max_running <= 0) {
+        fprintf(stderr, "turtle: usage: batch [-j N] command args...\n");
+        return -1;
+    }
+
+    batch.exec_path = cmd->argv[batch.start];
+    if (strchr(batch.exec_path, '/') == NULL) {
+        batch.exec_path = turtle_hash_lookup(batch.exec_path);
+    }
+    if (batch.exec_path == NULL) {
+        fprintf(stderr, "turtle could not find command: %s\n", cmd->argv[batch.start]);
+        return -1;
+    }
+
+    // everything from the first pattern to the last is split up, the rest goes with every batch
+    batch.first = -1;
+    batch.last = cmd->argc - 1;
+    for (int i = batch.start + 1; i < cmd->argc; i++) {
+        if (cmd->deferred != NULL && cmd->deferred[i]) {
+            if (batch.first < 0) {
+                batch.first = i;
+            }
+            batch.last = i;
+        }
+    }
+    if (batch.first < 0) {
+        batch.first = batch.start + 1;
+    }
+
+    batch.limit = turtle_arg_limit();
+    for (int i = batch.start; i < cmd->argc; i++) {
+        if (i < batch.first || i > batch.last) {
+            batch.limit -= strlen(cmd->argv[i]) + 1 + sizeof(char*);
+        }
+    }
+
+    struct Job* job = turtle_new_job();
+    job->mode_type = FOREGROUND;
+    turtle_insert_job(job);
+    turtle_pool_init(&batch.pool, job, max_running, 0, in_fd, out_fd);
+
+    // patterns are expanded straight into batches so their matches are never all held at once
+    for (int i = batch.first; i <= batch.last && !batch.pool.interrupted; i++) {
+        if (cmd->deferred != NULL && cmd->deferred[i]) {
+            if (turtle_glob_each(cmd->argv[i], turtle_batch_add, &batch) > 0) {
+                continue;
+            }
+            turtle_glob_literal(cmd->argv[i]);
+        }
+        turtle_batch_add(cmd->argv[i], &batch);
+    }
+    if ((batch.chunk_count > 0 || batch.tail == NULL) && !batch.pool.interrupted) {
+        turtle_batch_flush(&batch);
+    }
+    turtle_pool_finish(&batch.pool);
+
+    int batches = 0, failed = 0;
+    for (struct Command* cur_cmd = job->root; cur_cmd != NULL; cur_cmd = cur_cmd->next) {
+        batches++;
+        if (cur_cmd->status_type == QUEUED || cur_cmd->exit_code != 0) {
+            failed++;
+        }
+    }
+    for (struct Command* cur_cmd = batch.reclaim; cur_cmd != NULL; cur_cmd = cur_cmd->next) {
+        free(cur_cmd->argv);
+        cur_cmd->argv = NULL;
+    }
+    if (failed > 0) {
+        fprintf(stderr, "turtle: batch: %d of %d batches failed\n", failed, batches);
+    }
+
+    free(batch.strings);
+    turtle_remove_job(job->id);
+    return 1;
+}
+
+/* turns on or off splitting commands that expand past what exec accepts */
+int turtle_autobatch(int argc, char** argv) {
+    if (argc < 2) {
+        printf("autobatch %s\n", shell->autobatch ? "on" : "off");
+    } else if (strcmp(argv[1], "on") == 0) {
+        shell->autobatch = 1;
+    } else if (strcmp(argv[1], "off") == 0) {
+        shell->autobatch = 0;
+    } else {
+        fprintf(stderr, "turtle: usage: autobatch [on|off]\n");
+        return -1;
+    }
+    return 1;
+}
+
+/* turns the tracer on or off, or writes out what it recorded */
+int turtle_trace_cmd(int argc, char** argv) {
+    if (argc < 2) {
+        uint64_t head = turtle_trace.head;
+        printf("trace %s, %llu events recorded, %llu overwritten\n", turtle_trace.enabled ? "on" : "off",
+               (unsigned long long) head, (unsigned long long) (head > TRACE_EVENTS ? head - TRACE_EVENTS : 0));
+    } else if (strcmp(argv[1], "on") == 0) {
+        turtle_trace_enable(1);
+    } else if (strcmp(argv[1], "off") == 0) {
+        turtle_trace_enable(0);
+    } else if (strcmp(argv[1], "clear") == 0) {
+        turtle_trace_clear();
+    } else if (strcmp(argv[1], "dump") == 0) {
+        // dump [-l] [file], where -l asks for one JSON object per line
+        int jsonl = argc > 2 && strcmp(argv[2], "-l") == 0;
+        char* path = argc > 2 + jsonl ? argv[2 + jsonl] : NULL;
+        FILE* out = path != NULL ? fopen(path, "w") : stdout;
+        if (out == NULL) {
+            fprintf(stderr, "turtle: trace: could not write %s\n", path);
+            return -1;
+        }
+        turtle_trace_dump(out, jsonl);
+        if (path != NULL) {
+            fclose(out);
+        }
+    } else {
+        fprintf(stderr, "turtle: usage: trace [on|off|clear|dump [-l] [file]]\n");
+        return -1;
+    }
+    return 1;
+}
+
+/* write the character a backslash escape stands for, text pointing just past the backslash
+   echo style octal needs a leading 0, as in \0nnn, where printf takes \nnn
+   returns how many characters of text the escape used, or -1 for \c, which ends all output */
+int turtle_put_escape(const char* text, FILE* out, int echo_style) {
+    const char* start = text;
+    switch (*text) {
+    case 'a': fputc('\a', out); return 1;
+    case 'b': fputc('\b', out); return 1;
+    case 'c': return -1;
+    case 'e': fputc('\033', out); return 1;
+    case 'f': fputc('\f', out); return 1;
+    case 'n': fputc('\n', out); return 1;
+    case 'r': fputc('\r', out); return 1;
+    case 't': fputc('\t', out); return 1;
+    case 'v': fputc('\v', out); return 1;
+    case '\\': fputc('\\', out); return 1;
+    case '\0': fputc('\\', out); return 0;
+    }
+
+    if (*text == 'x' && isxdigit((unsigned char) text[1])) {
+        int value = 0;
+        text++;
+        for (int i = 0; i < 2 && isxdigit((unsigned char) *text); i++, text++) {
+            value = value * 16 + (isdigit((unsigned char) *text) ? *text - '0' : tolower((unsigned char) *text) - 'a' + 10);
+        }
+        fputc(value, out);
+        return text - start;
+    }
+
+    if (echo_style ? *text == '0' : (*text >= '0' && *text <= '7')) {
+        int value = 0;
+        if (echo_style) {
+            text++;
+        }
+        for (int i = 0; i < 3 && *text >= '0' && *text <= '7'; i++, text++) {
+            value = value * 8 + (*text - '0');
+        }
+        fputc(value, out);
+        return text - start;
+    }
+
+    // not an escape we know, so it is printed as typed
+    fputc('\\', out);
+    fputc(*text, out);
+    return 1;
+}
+
+/* prints its arguments; -n leaves off the newline and -e turns on backslash escapes */
+int turtle_echo(int argc, char** argv, FILE* out) {
+    int newline = 1, escapes = 0;
+    int index = 1;
+
+    // an argument is only an option if every letter in it is one
+    for (; index < argc && argv[index][0] == '-' && argv[index][1] != '\0'; index++) {
+        if (strspn(argv[index] + 1, "neE") != strlen(argv[index] + 1)) {
+            break;
+        }
+        for (char* option = argv[index] + 1; *option != '\0'; option++) {
+            if (*option == 'n') {
+                newline = 0;
+            } else {
+                escapes = *option == 'e';
+            }
+        }
+    }
+
+    for (int i = index; i < argc; i++) {
+        if (i > index) {
+            fputc(' ', out);
+        }
+        if (!escapes) {
+            fputs(argv[i], out);
+            continue;
+        }
+        for (char* cur = argv[i]; *cur != '\0'; cur++) {
+            if (*cur != '\\') {
+                fputc(*cur, out);
+                continue;
+            }
+            int used = turtle_put_escape(cur + 1, out, 1);
+            if (used < 0) {
+                return 0;
+            }
+            cur += used;
+        }
+    }
+
+    if (newline) {
+        fputc('\n', out);
+    }
+    return 0;
+}
+
+/* read a printf argument as a number, accepting 'c for the value of a character */
+static int turtle_printf_number(const char* value, long long* number, int is_unsigned) {
+    if (value == NULL || *value == '\0') {
+        *number = 0;
+        return 0;
+    }
+    if (value[0] == '\'' || value[0] == '"') {
+        *number = (unsigned char) value[1];
+        return 0;
+    }
+
+    char* end;
+    errno = 0;
+    *number = is_unsigned ? (long long) strtoull(value, &end, 0) : strtoll(value, &end, 0);
+    if (*end != '\0' || errno != 0) {
+        fprintf(stderr, "turtle: printf: %s: invalid number\n", value);
+        return 1;
+    }
+    return 0;
+}
+
+/* formats its arguments like printf(3), reusing the format until they run out */
+int turtle_printf(int argc, char** argv, FILE* out) {
+    if (argc < 2) {
+        fprintf(stderr, "turtle: usage: printf format [arguments...]\n");
+        return 2;
+    }
+
+    char* format = argv[1];
+    int arg = 2, code = 0;
+    do {
+        int first_arg = arg;
+        for (char* cur = format; *cur != '\0'; ) {
+            if (*cur == '\\') {
+                int used = turtle_put_escape(cur + 1, out, 0);
+                if (used < 0) {
+                    return code;
+                }
+                cur += used + 1;
+                continue;
+            }
+            if (*cur != '%') {
+                fputc(*cur++, out);
+                continue;
+            }
+            if (cur[1] == '%') {
+                fputc('%', out);
+                cur += 2;
+                continue;
+            }
+
+            // copy the flags, width and precision, then add the conversion at full width
+            char spec[32];
+            int length = 0;
+            spec[length++] = *cur++;
+            while (*cur != '\0' && strchr("-+ #0", *cur) != NULL && length < 8) {
+                spec[length++] = *cur++;
+            }
+            while (isdigit((unsigned char) *cur) && length < 16) {
+                spec[length++] = *cur++;
+            }
+            if (*cur == '.') {
+                spec[length++] = *cur++;
+                while (isdigit((unsigned char) *cur) && length < 24) {
+                    spec[length++] = *cur++;
+                }
+            }
+
+            char conversion = *cur;
+            if (conversion == '\0') {
+                fprintf(stderr, "turtle: printf: %s: missing conversion\n", format);
+                return 1;
+            }
+            cur++;
+            char* value = arg < argc ? argv[arg++] : NULL;
+            long long number;
+
+            if (strchr("diouxX", conversion) != NULL) {
+                code |= turtle_printf_number(value, &number, strchr("di", conversion) == NULL);
+                spec[length++] = 'l';
+                spec[length++] = 'l';
+                spec[length++] = conversion;
+                spec[length] = '\0';
+                fprintf(out, spec, number);
+            } else if (strchr("fFeEgGaA", conversion) != NULL) {
+                char* end = "";
+                double real = value != NULL ? strtod(value, &end) : 0;
+                if (*end != '\0') {
+                    fprintf(stderr, "turtle: printf: %s: invalid number\n", value);
+                    code = 1;
+                }
+                spec[length++] = conversion;
+                spec[length] = '\0';
+                fprintf(out, spec, real);
+            } else if (conversion == 'c') {
+                spec[length++] = 'c';
+                spec[length] = '\0';
+                if (value != NULL && *value != '\0') {
+                    fprintf(out, spec, value[0]);
+                }
+            } else if (conversion == 's' || conversion == 'b') {
+                char* text = value != NULL ? value : "";
+                char* expanded = NULL;
+                size_t expanded_size = 0;
+                int stop = 0;
+
+                // %b takes the escapes in its argument the way echo -e does
+                if (conversion == 'b') {
+                    FILE* escaped = open_memstream(&expanded, &expanded_size);
+                    for (char* c = text; *c != '\0'; c++) {
+                        if (*c != '\\') {
+                            fputc(*c, escaped);
+                            continue;
+                        }
+                        int used = turtle_put_escape(c + 1, escaped, 1);
+                        if (used < 0) {
+                            stop = 1;
+                            break;
+                        }
+                        c += used;
+                    }
+                    fclose(escaped);
+                    text = expanded;
+                }
+                spec[length++] = 's';
+                spec[length] = '\0';
+                fprintf(out, spec, text);
+                free(expanded);
+                if (stop) {
+                    return code;
+                }
+            } else {
+                fprintf(stderr, "turtle: printf: %%%c: invalid conversion\n", conversion);
+                return 1;
+            }
+        }
+
+        // a format that takes no arguments is printed once however many there are
+        if (arg == first_arg) {
+            break;
+        }
+    } while (arg < argc);
+
+    return code;
+}
+
+/* evaluate one of test's operators that take a single argument
+   returns 1 for true, 0 for false, and -1 if op is not one */
+static int turtle_test_unary(const char* op, const char* arg) {
+    struct stat info;
+    if (op[0] != '-' || op[1] == '\0' || op[2] != '\0') {
+        return -1;
+    }
+
+    switch (op[1]) {
+    case 'n': return arg[0] != '\0';
+    case 'z': return arg[0] == '\0';
+    case 'e': return stat(arg, &info) == 0;
+    case 'f': return stat(arg, &info) == 0 && S_ISREG(info.st_mode);
+    case 'd': return stat(arg, &info) == 0 && S_ISDIR(info.st_mode);
+    case 'b': return stat(arg, &info) == 0 && S_ISBLK(info.st_mode);
+    case 'c': return stat(arg, &info) == 0 && S_ISCHR(info.st_mode);
+    case 'p': return stat(arg, &info) == 0 && S_ISFIFO(info.st_mode);
+    case 'S': return stat(arg, &info) == 0 && S_ISSOCK(info.st_mode);
+    case 's': return stat(arg, &info) == 0 && info.st_size > 0;
+    case 'g': return stat(arg, &info) == 0 && (info.st_mode & S_ISGID);
+    case 'u': return stat(arg, &info) == 0 && (info.st_mode & S_ISUID);
+    case 'k': return stat(arg, &info) == 0 && (info.st_mode & S_ISVTX);
+    case 'h':
+    case 'L': return lstat(arg, &info) == 0 && S_ISLNK(info.st_mode);
+    case 'r': return access(arg, R_OK) == 0;
+    case 'w': return access(arg, W_OK) == 0;
+    case 'x': return access(arg, X_OK) == 0;
+    case 't': return isatty(atoi(arg));
+    }
+    return -1;
+}
+
+/* read an operand of an integer comparison, flagging anything that is not a number */
+static long long turtle_test_integer(const char* text, int* error) {
+    char* end;
+    errno = 0;
+    long long value = strtoll(text, &end, 10);
+    while (isspace((unsigned char) *end)) {
+        end++;
+    }
+    if (text[0] == '\0' || *end != '\0' || errno != 0) {
+        fprintf(stderr, "turtle: test: %s: integer expression expected\n", text);
+        *error = 1;
+    }
+    return value;
+}
+
+/* evaluate one of test's operators that compare two arguments
+   returns 1 for true, 0 for false, and -1 if op is not one */
+static int turtle_test_binary(const char* left, const char* op, const char* right, int* error) {
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) {
+        return strcmp(left, right) == 0;
+    } else if (strcmp(op, "!=") == 0) {
+        return strcmp(left, right) != 0;
+    } else if (strcmp(op, "<") == 0) {
+        return strcmp(left, right) < 0;
+    } else if (strcmp(op, ">") == 0) {
+        return strcmp(left, right) > 0;
+    }
+
+    struct stat left_info, right_info;
+    if (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0 || strcmp(op, "-ef") == 0) {
+        int left_ok = stat(left, &left_info) == 0;
+        int right_ok = stat(right, &right_info) == 0;
+        if (op[1] == 'e') {
+            return left_ok && right_ok && left_info.st_dev == right_info.st_dev && left_info.st_ino == right_info.st_ino;
+        }
+        if (op[1] == 'o') {
+            struct stat swap = left_info;
+            left_info = right_info;
+            right_info = swap;
+            int swap_ok = left_ok;
+            left_ok = right_ok;
+            right_ok = swap_ok;
+        }
+        // a file that exists is newer than one that does not
+        if (!left_ok || !right_ok) {
+            return left_ok;
+        }
+        return left_info.st_mtim.tv_sec > right_info.st_mtim.tv_sec
+               || (left_info.st_mtim.tv_sec == right_info.st_mtim.tv_sec
+                   && left_info.st_mtim.tv_nsec > right_info.st_mtim.tv_nsec);
+    }
+
+    const char* compares[] = {"-eq", "-ne", "-lt", "-le", "-gt", "-ge"};
+    for (int i = 0; i < 6; i++) {
+        if (strcmp(op, compares[i]) != 0) {
+            continue;
+        }
+        long long a = turtle_test_integer(left, error);
+        long long b = turtle_test_integer(right, error);
+        switch (i) {
+        case 0: return a == b;
+        case 1: return a != b;
+        case 2: return a < b;
+        case 3: return a <= b;
+        case 4: return a > b;
+        default: return a >= b;
+        }
+    }
+    return -1;
+}
+
+static int turtle_test_or(char** argv, int* pos, int end, int* error);
+
+/* a single condition: ( expression ), ! condition, a comparison, a file test, or a plain string */
+static int turtle_test_primary(char** argv, int* pos, int end, int* error) {
+    if (*pos >= end) {
+        fprintf(stderr, "turtle: test: argument expected\n");
+        *error = 1;
+        return 0;
+    }
+
+    char* word = argv[*pos];
+    if (strcmp(word, "!") == 0) {
+        (*pos)++;
+        return !turtle_test_primary(argv, pos, end, error);
+    }
+    if (strcmp(word, "(") == 0) {
+        (*pos)++;
+        int result = turtle_test_or(argv, pos, end, error);
+        if (*pos >= end || strcmp(argv[*pos], ")") != 0) {
+            fprintf(stderr, "turtle: test: missing )\n");
+            *error = 1;
+            return 0;
+        }
+        (*pos)++;
+        return result;
+    }
+    if (*pos + 1 < end) {
+        int result = *pos + 2 < end ? turtle_test_binary(word, argv[*pos + 1], argv[*pos + 2], error) : -1;
+        if (result >= 0) {
+            *pos += 3;
+            return result;
+        }
+        result = turtle_test_unary(word, argv[*pos + 1]);
+        if (result >= 0) {
+            *pos += 2;
+            return result;
+        }
+    }
+    (*pos)++;
+    return word[0] != '\0';
+}
+
+static int turtle_test_and(char** argv, int* pos, int end, int* error) {
+    int result = turtle_test_primary(argv, pos, end, error);
+    while (*pos < end && strcmp(argv[*pos], "-a") == 0) {
+        (*pos)++;
+        result = turtle_test_primary(argv, pos, end, error) && result;
+    }
+    return result;
+}
+
+static int turtle_test_or(char** argv, int* pos, int end, int* error) {
+    int result = turtle_test_and(argv, pos, end, error);
+    while (*pos < end && strcmp(argv[*pos], "-o") == 0) {
+        (*pos)++;
+        result = turtle_test_and(argv, pos, end, error) || result;
+    }
+    return result;
+}
+
+/* evaluate count arguments, settling the short forms the way POSIX spells out */
+static int turtle_test_eval(char** argv, int count, int* error) {
+    if (count == 0) {
+        return 0;
+    } else if (count == 1) {
+        return argv[0][0] != '\0';
+    } else if (count == 2 && strcmp(argv[0], "!") == 0) {
+        return argv[1][0] == '\0';
+    } else if (count == 3) {
+        int result = turtle_test_binary(argv[0], argv[1], argv[2], error);
+        if (result >= 0) {
+            return result;
+        }
+        if (strcmp(argv[0], "!") == 0) {
+            return !turtle_test_eval(argv + 1, 2, error);
+        }
+    } else if (count == 4 && strcmp(argv[0], "!") == 0) {
+        return !turtle_test_eval(argv + 1, 3, error);
+    }
+
+    int pos = 0;
+    int result = turtle_test_or(argv, &pos, count, error);
+    if (pos < count && !*error) {
+        fprintf(stderr, "turtle: test: %s: unexpected argument\n", argv[pos]);
+        *error = 1;
+    }
+    return result;
+}
+
+/* checks a condition, exiting 0 if it holds, 1 if not, and 2 if it could not be read */
+int turtle_test(int argc, char** argv) {
+    int count = argc - 1;
+    if (strcmp(argv[0], "[") == 0) {
+        if (argc < 2 || strcmp(argv[argc - 1], "]") != 0) {
+            fprintf(stderr, "turtle: [: missing ]\n");
+            return 2;
+        }
+        count--;
+    }
+
+    int error = 0;
+    int result = turtle_test_eval(argv + 1, count, &error);
+    if (error) {
+        return 2;
+    }
+    return result ? 0 : 1;
+}
+
+/* prints the directory the shell is in */
+int turtle_pwd(FILE* out) {
+    char dir[MAX_PATH_LENGTH];
+    if (getcwd(dir, sizeof(dir)) == NULL) {
+        fprintf(stderr, "turtle: pwd: %s\n", strerror(errno));
+        return 1;
+    }
+    fprintf(out, "%s\n", dir);
+    return 0;
+}
+
+/* copies each file, or the input when there are none, to out_fd without reading it into the shell */
+int turtle_cat(int argc, char** argv, int in_fd, int out_fd) {
+    int status = 0;
+
+    // anything the shell printed has to come out ahead of the file
+    fflush(stdout);
+    for (int i = 1; i < argc || i == 1; i++) {
+        int fd = in_fd;
+        if (i < argc && strcmp(argv[i], "-") != 0) {
+            fd = open(argv[i], O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                fprintf(stderr, "turtle: cat: %s: %s\n", argv[i], strerror(errno));
+                status = 1;
+                continue;
+            }
+        }
+
+        if (turtle_move(fd, out_fd) < 0) {
+            if (errno == EINTR) {
+                status = 130;
+            } else {
+                fprintf(stderr, "turtle: cat: %s: %s\n", i < argc ? argv[i] : "-", strerror(errno));
+                status = 1;
+            }
+        }
+        if (fd != in_fd) {
+            close(fd);
+        }
+        if (status == 130) {
+            break;
+        }
+    }
+    return status;
+}
+
+/* copies the input to out_fd and to every file named; -a appends to the files instead */
+int turtle_tee(int argc, char** argv, int in_fd, int out_fd) {
+    int append = 0, status = 0, count = 0;
+    int first = 1;
+    if (argc > 1 && strcmp(argv[1], "-a") == 0) {
+        append = 1;
+        first = 2;
+    }
+
+    int* out_fds = malloc((argc - first + 1) * sizeof(int));
+    fflush(stdout);
+    out_fds[count++] = out_fd;
+    for (int i = first; i < argc; i++) {
+        int fd = open(argv[i], O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0644);
+        if (fd < 0) {
+            fprintf(stderr, "turtle: tee: %s: %s\n", argv[i], strerror(errno));
+            status = 1;
+            continue;
+        }
+        out_fds[count++] = fd;
+    }
+
+    if (turtle_fan_out(in_fd, out_fds, count) < 0) {
+        if (errno == EINTR) {
+            status = 130;
+        } else {
+            fprintf(stderr, "turtle: tee: %s\n", strerror(errno));
+            status = 1;
+        }
+    }
+    for (int i = 1; i < count; i++) {
+        close(out_fds[i]);
+    }
+    free(out_fds);
+    return status;
+}
+
 /* prints basic information about this shell */
 int turtle_help() {
     printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
@@ -127,49 +1210,169 @@ int turtle_help() {
     printf("to use, type a valid command followed by any relevant arguments\n");
     printf("the following functionalities are provided:\n");
     printf("\tbuiltins like help, cd, turtlesay, exit, unset, kill, fg, bg, and jobs\n");
-    printf("\tsaves command history with the history command\n");
+    printf("\tremembers where commands live, see hash (hash -r to forget)\n");
+    printf("\tchoose how commands are started with engine fork, vfork, or spawn\n");
+    printf("\tcheck memory held by jobs with arena\n");
+    printf("\tlimit running background jobs with sched on, sched off, sched -j N, or sched -c\n");
+    printf("\tfan a command across cores with parallel [-j N] [-g] command {} ::: items...\n");
+    printf("\tsee how often wildcards reuse cached directories with globcache, or clear it with globcache -r\n");
+    printf("\tsplit a command too long for exec into runs with batch [-j N] command args..., or always with autobatch on\n");
+    printf("\techo, printf, test, [, true, false and pwd run inside the shell without starting a program\n");
+    printf("\tsee what flows through each pipe with meter command | command..., then jobs, or size them with pipesize bytes|max\n");
+    printf("\tcat and tee [-a] move data with splice, tee, sendfile or copy_file_range instead of copying it\n");
+    printf("\ttrace where the shell spends its time with trace on, then trace dump [-l] [file], or set TURTLE_TRACE\n");
+    printf("\tsaves command history to ~/.turtle_history, see history [count], recall with !!, !n, !-n or !prefix\n");
+    printf("\tfind old commands with history search text, or search as you type with history search\n");
+    printf("\tset TURTLE_SHARED_HISTORY=1 to see commands from other running shells at your next prompt\n");
+    printf("\tadd the git branch, how long the last command took and the load average to the prompt with prompt on branch duration load\n");
+    printf("\tthe status of the last command is in $?, and the shell exits with it at the end of a script\n");
+    printf("\tedit lines with emacs keys, search history with ctrl-r, and complete commands, paths and $VARS with tab\n");
     printf("\ti/o redirection\n");
     printf("\tpiping\n");
     printf("\thandling signals\n");
     printf("\thandling wildcards like * and ?\n");
     printf("\tother fun features like theme\n");
+    printf("\tbatch mode with shell -c 'commands', shell script.turtle, or piped input\n");
     printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
     return 1;
 }
 
-int turtle_history() {
-    int i = 0;
-    struct History* current = turtle_head;
-    while (i < 5 && current != NULL) {
-        printf("[%d] %s\n", i, current->history_command);
-        current = current->turtle_next;
-        i++;
+// print the best matches for text, numbered from 1 for picking one
+static long turtle_history_matches(const char* text, long* results) {
+    // the newest command is the search itself, which would always match
+    long found = turtle_history_search(text, results, HISTORY_MATCHES + 1);
+    for (long i = 0; i < found; i++) {
+        if (results[i] == turtle_history_log.count) {
+            memmove(results + i, results + i + 1, (found - i - 1) * sizeof(long));
+            found--;
+            break;
+        }
     }
+    if (found > HISTORY_MATCHES) {
+        found = HISTORY_MATCHES;
+    }
+
+    // commands that can no longer be read back are left out, so every number shown can be picked
+    long shown = 0;
+    for (long i = 0; i < found; i++) {
+        size_t length;
+        const char* command = turtle_history_get(results[i], &length);
+        if (command != NULL) {
+            results[shown] = results[i];
+            printf("%3ld) %5ld  %.*s\n", shown + 1, results[shown], (int) length, command);
+            shown++;
+        }
+    }
+    found = shown;
+    if (found == 0) {
+        printf("no matches\n");
+    }
+    return found;
+}
+
+// search as the text is built up: each line typed narrows the search down by adding to the text,
+// a match's number runs it, - takes back the last line, and an empty line stops
+static int turtle_history_search_mode() {
+    long results[HISTORY_MATCHES + 1];
+    char text[MAX_PATH_LENGTH] = "";
+    size_t lengths[MAX_PATH_LENGTH];
+    int steps = 0;
+    long found = 0;
 
-    printf("enter command number > ");
-    int letter;
-    int index = 0;
-    char* buffer = malloc(sizeof(char) * 2);
     while (1) {
-        letter = getchar();
-        if (letter == EOF || letter == '\n' || letter == '\r') {
-            break;
+        char prompt[MAX_PATH_LENGTH + 16];
+        snprintf(prompt, sizeof(prompt), "search '%s'> ", text);
+        turtle_input.prompt = prompt;
+        char* line = turtle_read_line();
+        if (line == NULL || line[0] == '\0') {
+            return 1;
+        }
+
+        char* end;
+        long pick = strtol(line, &end, 10);
+        if (*end == '\0' && pick >= 1 && pick <= found) {
+            size_t length;
+            const char* command = turtle_history_get(results[pick - 1], &length);
+            char* picked = strndup(command, length);
+            printf("%s\n", picked);
+            struct Job* job = turtle_parse(picked);
+            free(picked);
+            return job == NULL ? -1 : turtle_execute(job);
+        }
+
+        if (strcmp(line, "-") == 0) {
+            if (steps > 0) {
+                text[lengths[--steps]] = '\0';
+            }
+        } else if (steps < MAX_PATH_LENGTH && strlen(text) + strlen(line) < sizeof(text)) {
+            lengths[steps++] = strlen(text);
+            strcat(text, line);
+        }
+        found = turtle_history_matches(text, results);
+    }
+}
+
+/* lists the newest commands with their numbers, then runs the one picked; !n does the same in one step
+   history search text finds the commands containing text, and history search alone searches as you type */
+int turtle_history(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "search") == 0) {
+        if (argc == 2) {
+            return turtle_history_search_mode();
+        }
+
+        // the words are searched for as they were typed, spaces and all
+        size_t size = 1;
+        for (int i = 2; i < argc; i++) {
+            size += strlen(argv[i]) + 1;
+        }
+        char* text = calloc(size, 1);
+        for (int i = 2; i < argc; i++) {
+            if (i > 2) {
+                strcat(text, " ");
+            }
+            strcat(text, argv[i]);
+        }
+        long results[HISTORY_MATCHES + 1];
+        long found = turtle_history_matches(text, results);
+        free(text);
+        return found > 0 ? 1 : -1;
+    }
+
+    long shown = argc > 1 ? atol(argv[1]) : HISTORY_LIST;
+    if (shown <= 0) {
+        fprintf(stderr, "turtle: usage: history [count]\n");
+        return -1;
+    }
+
+    long first = turtle_history_log.count - shown + 1;
+    for (long number = first < 1 ? 1 : first; number <= turtle_history_log.count; number++) {
+        size_t length;
+        const char* command = turtle_history_get(number, &length);
+        if (command != NULL) {
+            printf("%5ld  %.*s\n", number, (int) length, command);
         }
-        buffer[index] = letter;
-        index++;
     }
-    buffer[index] = 0;
-    letter = atoi(buffer);
+
+    turtle_input.prompt = "enter command number > ";
+    char* buffer = turtle_read_line();
+    if (buffer == NULL || buffer[strspn(buffer, " \t")] == '\0') {
+        return 1;
+    }
 
     // find the command with that number
-    i = 0;
-    current = turtle_head;
-    while (i < letter && current != NULL) {
-        current = current->turtle_next;
-        i++;
+    size_t length;
+    const char* command = turtle_history_get(atol(buffer), &length);
+    if (command == NULL) {
+        printf("turtle: no such command in history\n");
+        return -1;
     }
 
-    struct Job* job = turtle_parse(current->history_command);
+    char* line = strndup(command, length);
+    struct Job* job = turtle_parse(line);
+    free(line);
+    if (job == NULL) {
+        return -1;
+    }
 
     int status = turtle_execute(job);
     
@@ -270,6 +1473,48 @@ int turtlesay(char** args) {
     return 1;
 }
 
+/* lists the prompt's segments, turns them on or off, or sets how long a prompt waits for the slow ones
+   prompt [on|off segment...] or prompt timeout ms */
+int turtle_prompt_cmd(int argc, char** argv) {
+    if (argc == 1) {
+        for (int i = 0; i < NUM_PROMPT_SEGMENTS; i++) {
+            printf("%-9s %s\n", turtle_prompt_names[i], turtle_prompt.enabled[i] ? "on" : "off");
+        }
+        printf("timeout   %dms\n", turtle_prompt.timeout_ms);
+        return 1;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "timeout") == 0) {
+        char* end;
+        long ms = strtol(argv[2], &end, 10);
+        if (*end != '\0' || end == argv[2] || ms < 0 || ms > 10000) {
+            fprintf(stderr, "turtle: prompt timeout takes a number of milliseconds up to 10000\n");
+            return -1;
+        }
+        turtle_prompt.timeout_ms = ms;
+        return 1;
+    }
+
+    if (argc >= 3 && (strcmp(argv[1], "on") == 0 || strcmp(argv[1], "off") == 0)) {
+        for (int i = 2; i < argc; i++) {
+            int segment = 0;
+            while (segment < NUM_PROMPT_SEGMENTS && strcmp(argv[i], turtle_prompt_names[segment]) != 0) {
+                segment++;
+            }
+            if (segment == NUM_PROMPT_SEGMENTS) {
+                fprintf(stderr, "turtle: no prompt segment called %s, try user, dir, branch, duration or load\n", argv[i]);
+                return -1;
+            }
+            turtle_prompt.enabled[segment] = argv[1][1] == 'n';
+        }
+        turtle_prompt.stale = 1;
+        return 1;
+    }
+
+    fprintf(stderr, "turtle: usage: prompt [on|off segment...] or prompt timeout ms\n");
+    return -1;
+}
+
 void set_text(int color) { 
     if(((color > 37) || (color < 30)) && (color != 0)) {
         fprintf(stderr, "turtle: invalid color\n");
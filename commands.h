@@ -1,18 +1,39 @@
 #ifndef COMMANDS_H    /* This is an "include guard" */
 #define COMMANDS_H
 
+#include <stdio.h>
+
+struct Command;
+
 extern int first_color;
 extern int second_color;
 extern int third_color;
 extern int turtle_cd(int argc, char** args);
-extern int turtle_exit();
-extern int turtle_jobs();
+extern int turtle_exit(int argc, char** argv);
+extern int turtle_jobs(int argc, char** argv);
 extern int turtle_fg(int argc, char** argv);
 extern int turtle_bg(int argc, char** argv);
 extern int turtle_kill(int argc, char** argv);
 extern int turtle_unset(int argc, char** argv);
+extern int turtle_hash(int argc, char** argv);
+extern int turtle_engine_cmd(int argc, char** argv);
+extern int turtle_arena();
+extern int turtle_sched(int argc, char** argv);
+extern int turtle_parallel(int argc, char** argv, int in_fd, int out_fd);
+extern int turtle_globcache(int argc, char** argv);
+extern int turtle_batch(struct Command* cmd, int in_fd, int out_fd);
+extern int turtle_autobatch(int argc, char** argv);
+extern int turtle_trace_cmd(int argc, char** argv);
+extern int turtle_prompt_cmd(int argc, char** argv);
+extern int turtle_put_escape(const char* text, FILE* out, int echo_style);
+extern int turtle_echo(int argc, char** argv, FILE* out);
+extern int turtle_printf(int argc, char** argv, FILE* out);
+extern int turtle_test(int argc, char** argv);
+extern int turtle_pwd(FILE* out);
+extern int turtle_cat(int argc, char** argv, int in_fd, int out_fd);
+extern int turtle_tee(int argc, char** argv, int in_fd, int out_fd);
 extern int turtle_help();
-extern int turtle_history();
+extern int turtle_history(int argc, char** argv);
 extern int turtlesay(char** args);
 extern int turtle_theme(int argc, char** args);
 extern void turtle_theme_help();
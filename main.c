@@ -1,32 +1,89 @@
-#include "commands.h"
 #include "main.h"
+#include "commands.h"
 
 int first_color = 0;
 int second_color = 0;
 int third_color = 0;
 
+struct sigaction act_int;
+struct shell_info* shell;
+struct History turtle_history_log = {-1};
+struct History_Index turtle_history_index;
+struct Input_Reader turtle_input;
+struct Line_Editor turtle_editor;
+struct Prompt turtle_prompt;
+const char* turtle_prompt_names[NUM_PROMPT_SEGMENTS] = {"user", "dir", "branch", "duration", "load"};
+struct Hash_Entry* turtle_hash_table[HASH_SIZE];
+struct Dir_Entry* turtle_glob_cache[GLOB_CACHE_SIZE];
+struct Glob_Stats turtle_glob_stats;
+struct Trace_Ring turtle_trace;
+struct Arena_Block* turtle_arena_free_list;
+struct Arena_Stats turtle_arena_stats;
+enum engine turtle_engine = SPAWN_ENGINE;
+// every builtin by name, what turtle_get_cmd_type looks commands up in and tab completes from
+const struct Builtin turtle_builtins[] = {
+    {"exit", EXIT}, {"cd", CD}, {"jobs", JOBS}, {"fg", FG}, {"bg", BG}, {"kill", KILL}, {"unset", UNSET},
+    {"history", HISTORY}, {"theme", THEME}, {"help", HELP}, {"turtlesay", TURTLESAY}, {"hash", HASH},
+    {"engine", ENGINE}, {"arena", ARENA}, {"sched", SCHED}, {"parallel", PARALLEL}, {"globcache", GLOBCACHE},
+    {"batch", BATCH}, {"autobatch", AUTOBATCH}, {"echo", ECHO_UTIL}, {"printf", PRINTF_UTIL},
+    {"test", TEST_UTIL}, {"[", TEST_UTIL}, {"true", TRUE_UTIL}, {"false", FALSE_UTIL}, {"pwd", PWD_UTIL},
+    {"cat", CAT_MOVER}, {"tee", TEE_MOVER}, {"trace", TRACE}, {"prompt", PROMPT}, {NULL, EXTERNAL}
+};
+struct Engine_Stats turtle_engine_stats[NUM_ENGINES];
+
+#ifndef TURTLE_NO_MAIN
 int main(int argc, char** argv) {
+    int interactive = isatty(STDIN_FILENO);
+    char* command = NULL;
+    int script_fd = -1;
+
+    // shell -c 'command' runs the given commands and exits
+    if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "turtle: -c requires an argument\n");
+            return EXIT_FAILURE;
+        }
+        command = argv[2];
+        interactive = 0;
+    }
+    // shell script.turtle runs each line of the file
+    else if (argc > 1) {
+        script_fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+        if (script_fd < 0) {
+            fprintf(stderr, "turtle could not open script: %s\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+        interactive = 0;
+    }
+
     // initialize
-    turtle_init();
-    turtle_welcome();
+    turtle_init(interactive);
+    if (script_fd >= 0) {
+        turtle_input.fd = script_fd;
+    } else if (command != NULL) {
+        turtle_read_string(command);
+    }
+
+    if (interactive) {
+        turtle_welcome();
+    }
 
     // run command loop
     turtle_run();
 
-    // perform shutdown
-    return EXIT_SUCCESS;
+    // perform shutdown, reporting how the last command went the way other shells do
+    return shell->last_status;
 }
+#endif
 
 // make sure the shell is running interactively as the foreground job
 // this is needed in order to allow our shell to also be able to run job control
-void turtle_init() {
+// in batch mode the terminal is left alone and only the shell information is set up
+void turtle_init(int interactive) {
     pid_t turtle_pgid;
-
-    // check if we are running interactively (i.e. when STDIN is the terminal)
     int turtle_terminal = STDIN_FILENO;
-    int turtle_is_interactive = isatty(turtle_terminal);
 
-    if (turtle_is_interactive) {
+    if (interactive) {
         // loop until we are in the foreground
         while (tcgetpgrp(turtle_terminal) != (turtle_pgid = getpgrp())) {
             kill (-turtle_pgid, SIGTTIN);
@@ -43,16 +100,64 @@ void turtle_init() {
         pid_t pid = getpid();
         setpgid(pid, pid);
         tcsetpgrp(0, pid);
+    }
 
-        // set up information for the shell
-        shell = calloc(sizeof(struct shell_info), 1);
-        getlogin_r(shell->user, sizeof(shell->user));
-        struct passwd *temp_pw = getpwuid(getuid());
+    // set up information for the shell
+    shell = calloc(sizeof(struct shell_info), 1);
+    shell->interactive = interactive;
+    getlogin_r(shell->user, sizeof(shell->user));
+    struct passwd *temp_pw = getpwuid(getuid());
+    if (temp_pw != NULL) {
         strcpy(shell->pw_dir, temp_pw->pw_dir);
-        getcwd(shell->dir, sizeof(shell->dir));
-        for (int i = 0; i < MAX_NUM_JOBS; i++) {
-            shell->jobs[i] = NULL;
+    }
+    getcwd(shell->dir, sizeof(shell->dir));
+    if (interactive) {
+        turtle_history_init();
+    }
+
+    // the prompt starts out as the user and the directory; the rest are turned on with the prompt builtin
+    char* logname = getenv("LOGNAME");
+    snprintf(turtle_prompt.user, sizeof(turtle_prompt.user), "%s", logname != NULL ? logname : shell->user);
+    turtle_prompt.enabled[PROMPT_USER] = 1;
+    turtle_prompt.enabled[PROMPT_DIR] = 1;
+    turtle_prompt.timeout_ms = PROMPT_TIMEOUT_MS;
+    turtle_prompt.stale = 1;
+    shell->jobs_size = JOBS_SIZE;
+    shell->jobs = calloc(shell->jobs_size, sizeof(struct Job*));
+    shell->jobs_free = 1;
+    shell->pid_index_size = PID_INDEX_SIZE;
+    shell->pid_index = calloc(shell->pid_index_size, sizeof(struct Command*));
+    shell->sched_max = sysconf(_SC_NPROCESSORS_ONLN);
+
+    // pipes can be grown up to the limit the system sets for unprivileged users
+    shell->pipe_max = 1 << 20;
+    FILE* pipe_max_file = fopen("/proc/sys/fs/pipe-max-size", "r");
+    if (pipe_max_file != NULL) {
+        if (fscanf(pipe_max_file, "%d", &shell->pipe_max) != 1 || shell->pipe_max < PIPE_DEFAULT_SIZE) {
+            shell->pipe_max = PIPE_DEFAULT_SIZE;
         }
+        fclose(pipe_max_file);
+    }
+    turtle_trace_init();
+
+    // children are reaped when SIGCHLD shows up on a signalfd instead of in a handler
+    sigset_t child_signals;
+    sigemptyset(&child_signals);
+    sigaddset(&child_signals, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &child_signals, NULL);
+    shell->child_fd = signalfd(-1, &child_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    // set up the buffers used to read commands
+    turtle_input.fd = STDIN_FILENO;
+    turtle_input.block = malloc(READ_BLOCK);
+    turtle_input.line_size = INPUT_SIZE;
+    turtle_input.line = malloc(turtle_input.line_size);
+    if (!turtle_input.block || !turtle_input.line) {
+        fprintf(stderr, "turtle failed to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+    if (interactive) {
+        turtle_editor_init();
     }
 }
 
@@ -79,599 +184,5169 @@ void turtle_run() {
     struct Job* job;
 
     while (1) {
-        set_text(first_color);
-        printf("%s@turtle ", getenv("LOGNAME"));
+        // clean up background jobs that finished while the last command ran,
+        // and pick up commands entered in other sessions meanwhile
+        turtle_check_children();
+        turtle_print_notices();
+        turtle_history_sync();
 
-        set_text(second_color);
-        printf("%s $ ", getcwd(shell->dir, 4096));
+        // batch mode skips the prompt entirely
+        uint64_t trace_start = turtle_trace_begin();
+        // the prompt is kept as one string so it goes out in one write and the line editor can draw it again
+        if (shell->interactive) {
+            turtle_input.prompt = turtle_prompt_render();
+            turtle_trace_end("prompt", NULL, trace_start, 0);
+        }
 
-        set_text(third_color);
+        trace_start = turtle_trace_begin();
         input = turtle_read();
+        turtle_trace_end("read", NULL, trace_start, input != NULL ? strlen(input) : 0);
+
+        // stop at the end of input just like the exit builtin
+        // a batch of commands first lets its queued background jobs run
+        if (input == NULL) {
+            if (shell->interactive) {
+                printf("\n");
+                turtle_exit(1, NULL);
+            }
+            turtle_sched_drain();
+            return;
+        }
 
+        // nothing to do for a blank line or a comment
+        int skip = strspn(input, " \t\r\n\a");
+        if (input[skip] == '\0' || input[skip] == '#') {
+            continue;
+        }
+
+        trace_start = turtle_trace_begin();
         job = turtle_parse(input);
+        turtle_trace_end("parse", NULL, trace_start, 0);
+        if (job == NULL) {
+            continue;
+        }
 
+        trace_start = turtle_trace_begin();
+        struct timespec started, finished;
+        clock_gettime(CLOCK_MONOTONIC, &started);
         turtle_execute(job);
+        clock_gettime(CLOCK_MONOTONIC, &finished);
+        turtle_prompt.duration = turtle_seconds(&started, &finished);
+        turtle_trace_end("execute", NULL, trace_start, 0);
     }
 }
 
-char* turtle_read() {
-    int buffer_size = INPUT_SIZE;
-    int index = 0;
-    char* buffer = malloc(sizeof(char) * buffer_size);
-    int letter;
-
-    // make sure we had a successful malloc
-    if (!buffer) {
-        fprintf(stderr, "turtle failed to read\n");
-        exit(EXIT_FAILURE);
+// build the prompt, redoing the user and directory only after cd, the theme or the prompt builtin changed them,
+// and the rest only when it is turned on
+const char* turtle_prompt_render() {
+    struct Prompt* p = &turtle_prompt;
+    if (p->colors[0] != first_color || p->colors[1] != second_color || p->colors[2] != third_color) {
+        p->colors[0] = first_color;
+        p->colors[1] = second_color;
+        p->colors[2] = third_color;
+        p->stale = 1;
     }
 
-    // read in input from the user until we hit the last character
-    while (1) {
-        letter = getchar();
-
-        // check if this char is the last character
-        if (letter == EOF) {
-            buffer[index] = '\0'; // null terminate strings
-
-            // copy this string into the history
-            if (strcmp(buffer, "history") != 0) {
-                struct History* new_command = calloc(sizeof(struct History*), 1);
-                new_command->history_command = calloc(sizeof(char) * strlen(buffer), 1);
-                strcpy(new_command->history_command, buffer);
-                if (turtle_head != NULL) {
-                    new_command->turtle_next = turtle_head;
-                }
-                turtle_head = new_command;
-            }
-
-            return buffer;
-        }
-        // handle special newline case
-        else if (letter == '\n') {
-            // be able to handle multiple lines of input
-            if (index == 0 || buffer[index-1] != '\\') {
-                buffer[index] = '\0';
+    int dynamic = p->enabled[PROMPT_BRANCH] || p->enabled[PROMPT_DURATION] || p->enabled[PROMPT_LOAD];
+    if (!p->stale && !dynamic) {
+        return p->text;
+    }
 
-                // copy this string into the history
-                if (strcmp(buffer, "history") != 0) {
-                    struct History* new_command = calloc(sizeof(struct History*), 1);
-                    new_command->history_command = calloc(sizeof(char) * strlen(buffer), 1);
-                    strcpy(new_command->history_command, buffer);
-                    if (turtle_head != NULL) {
-                        new_command->turtle_next = turtle_head;
-                    }
-                    turtle_head = new_command;
-                }
-                
-                return buffer;
-            } else {
-                index-=2;
-                printf("> ");
-            }
+    size_t size = sizeof(p->text);
+    if (p->stale) {
+        int used = 0;
+        if (p->enabled[PROMPT_USER]) {
+            used += snprintf(p->text + used, size - used, "\033[1;%dm%s@turtle ", first_color, p->user);
         }
-        // read input as normally
-        else {
-            buffer[index] = letter;
-            index++;
+        used += snprintf(p->text + used, size - used, "\033[1;%dm", second_color);
+        if (p->enabled[PROMPT_DIR]) {
+            used += snprintf(p->text + used, size - used, "%s ", shell->dir);
         }
+        p->fixed_length = used;
+        p->stale = 0;
+    }
 
-        // determine whether we need to allocate more space
-        if (index >= buffer_size) {
-            buffer_size += INPUT_SIZE;
-            buffer = realloc(buffer, buffer_size);
-
-            // make sure we had a successful malloc
-            if (!buffer) {
-                fprintf(stderr, "turtle failed to read\n");
-                exit(EXIT_FAILURE);
-            }
+    char branch[PROMPT_BRANCH_LENGTH] = "";
+    double load = -1;
+    if (p->enabled[PROMPT_BRANCH] || p->enabled[PROMPT_LOAD]) {
+        turtle_prompt_collect(branch, &load);
+    }
+    size_t used = p->fixed_length;
+    if (branch[0] != '\0') {
+        used += snprintf(p->text + used, size - used, "(%s) ", branch);
+    }
+    if (p->enabled[PROMPT_DURATION]) {
+        double seconds = p->duration;
+        if (seconds < 1) {
+            used += snprintf(p->text + used, size - used, "%dms ", (int) (seconds * 1000));
+        } else if (seconds < 60) {
+            used += snprintf(p->text + used, size - used, "%.1fs ", seconds);
+        } else {
+            used += snprintf(p->text + used, size - used, "%dm%02ds ", (int) seconds / 60, (int) seconds % 60);
         }
     }
+    if (load >= 0) {
+        used += snprintf(p->text + used, size - used, "%.2f ", load);
+    }
+    snprintf(p->text + used, size - used, "$ \033[1;%dm", third_color);
+    return p->text;
 }
 
-struct Job* turtle_parse(char* input) {
-    struct Command *root_cmd = NULL;
-    struct Command *cmd = NULL;
-    enum mode mode_type = FOREGROUND;
-
-    if (input[strlen(input) - 1] == '&') {
-        mode_type = BACKGROUND;
-        input[strlen(input) - 1] = '\0';
+// hand the background thread the current directory and wait a little for what it finds;
+// a thread still stuck on an earlier look is neither asked again nor waited on, so the prompt
+// makes do with the last answers rather than hang on a slow filesystem
+void turtle_prompt_collect(char* branch, double* load) {
+    struct Prompt* p = &turtle_prompt;
+    if (p->started < 0) {
+        return;
     }
+    if (p->started == 0) {
+        pthread_mutex_init(&p->lock, NULL);
+        pthread_cond_init(&p->wake, NULL);
+        pthread_condattr_t monotonic;
+        pthread_condattr_init(&monotonic);
+        pthread_condattr_setclock(&monotonic, CLOCK_MONOTONIC);
+        pthread_cond_init(&p->done, &monotonic);
+        pthread_condattr_destroy(&monotonic);
+        p->load = -1;
 
-    int num_commands = 0;
-    int input_index = 0;
-
-    // find how many comands there are
-    while (input[input_index] != '\0') {
-        if (input[input_index] == '|') {
-            num_commands++;
+        // the thread must never take a signal meant for the shell
+        sigset_t all_signals, saved_signals;
+        sigfillset(&all_signals);
+        pthread_sigmask(SIG_SETMASK, &all_signals, &saved_signals);
+        p->started = pthread_create(&p->thread, NULL, turtle_prompt_worker, p) == 0 ? 1 : -1;
+        pthread_sigmask(SIG_SETMASK, &saved_signals, NULL);
+        if (p->started < 0) {
+            return;
         }
-        input_index++;
     }
-    num_commands++;
 
-    // parse through each individual command
-    char* save;
-    char* cur_cmd = strtok_r(input, "|", &save);
-    int i = 0;
-    while (cur_cmd != NULL && i < num_commands) {
-        struct Command* new_cmd = turtle_parse_single(cur_cmd);
-        if (!root_cmd) {
-            root_cmd = new_cmd;
-            cmd = root_cmd;
-        } else {
-            cmd->next = new_cmd;
-            cmd = new_cmd;
+    pthread_mutex_lock(&p->lock);
+    if (!p->busy) {
+        strcpy(p->ask_dir, shell->dir);
+        p->want_branch = p->enabled[PROMPT_BRANCH];
+        p->want_load = p->enabled[PROMPT_LOAD];
+        p->asked++;
+        p->busy = 1;
+        pthread_cond_signal(&p->wake);
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += p->timeout_ms / 1000;
+        deadline.tv_nsec += (p->timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while (p->busy && pthread_cond_timedwait(&p->done, &p->lock, &deadline) != ETIMEDOUT) {
         }
-        cur_cmd = strtok_r(NULL, "|", &save);
-        i++;
     }
 
-    // create a new job associated with this command
-    struct Job* new_job = calloc(sizeof(struct Job), 1);
-    new_job->root = root_cmd;
-    new_job->pgid = -1;
-    new_job->mode_type = mode_type;
-    return new_job;
+    // a branch found for some other directory would be wrong here, so it is left out until the thread catches up
+    if (p->enabled[PROMPT_BRANCH] && strcmp(p->branch_dir, shell->dir) == 0) {
+        strcpy(branch, p->branch);
+    }
+    if (p->enabled[PROMPT_LOAD]) {
+        *load = p->load;
+    }
+    pthread_mutex_unlock(&p->lock);
 }
 
-struct Command* turtle_parse_single(char* command) {
-    int buf_size = BUFFER_SIZE;
-    int position = 0;
-    char* arg;
-    char** args = calloc(buf_size * sizeof(char*), 1);
-
-    if (!args) {
-        fprintf(stderr, "turtle failed to allocate memory\n");
-        exit(EXIT_FAILURE);
-    }
+// works out the slow segments one directory at a time; it only uses open and read,
+// so a fork in the middle of a look never inherits a lock it holds
+void* turtle_prompt_worker(void* arg) {
+    struct Prompt* p = arg;
+    char dir[MAX_PATH_LENGTH];
+    char branch[PROMPT_BRANCH_LENGTH];
 
-    arg = strtok(command, " \t\r\n\a");
-    while (arg != NULL) {
-        glob_t glob_buffer;
-        int glob_count = 0;
-        if (strchr(arg, '*') != NULL || strchr(arg, '?') != NULL) {
-            glob(arg, 0, NULL, &glob_buffer);
-            glob_count = glob_buffer.gl_pathc;
+    pthread_mutex_lock(&p->lock);
+    while (1) {
+        while (p->answered == p->asked) {
+            pthread_cond_wait(&p->wake, &p->lock);
         }
+        long asked = p->asked;
+        int want_branch = p->want_branch;
+        int want_load = p->want_load;
+        strcpy(dir, p->ask_dir);
+        pthread_mutex_unlock(&p->lock);
 
-        if (position + glob_count >= buf_size) {
-            buf_size += BUFFER_SIZE;
-            buf_size += glob_count;
-            args = realloc(args, buf_size * sizeof(char*));
-            if (!args) {
-                fprintf(stderr, "turtle failed to allocate memory\n");
-                exit(EXIT_FAILURE);
-            }
+        branch[0] = '\0';
+        double load = -1;
+        if (want_branch) {
+            turtle_prompt_find_branch(dir, branch);
+        }
+        if (want_load && getloadavg(&load, 1) != 1) {
+            load = -1;
         }
 
-        if (glob_count > 0) {
-            for (int i = 0; i < glob_count; i++) {
-                args[position++] = strdup(glob_buffer.gl_pathv[i]);
+        pthread_mutex_lock(&p->lock);
+        strcpy(p->branch, branch);
+        strcpy(p->branch_dir, dir);
+        p->load = load;
+        p->answered = asked;
+        p->busy = 0;
+        pthread_cond_broadcast(&p->done);
+    }
+    return NULL;
+}
+
+// name the git branch checked out in dir or the nearest directory above it that has one,
+// or the start of the commit when the head is detached
+void turtle_prompt_find_branch(const char* dir, char* branch) {
+    char cur[MAX_PATH_LENGTH];
+    char head[PROMPT_BRANCH_LENGTH + 32];
+    char path[MAX_PATH_LENGTH + sizeof(head) + 16];
+    snprintf(cur, sizeof(cur), "%s", dir);
+
+    while (1) {
+        const char* base = strcmp(cur, "/") == 0 ? "" : cur;
+        snprintf(path, sizeof(path), "%s/.git/HEAD", base);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+        // worktrees and submodules have a .git file naming the directory that holds HEAD
+        if (fd < 0 && errno == ENOTDIR) {
+            snprintf(path, sizeof(path), "%s/.git", base);
+            int link_fd = open(path, O_RDONLY | O_CLOEXEC);
+            ssize_t count = link_fd < 0 ? -1 : read(link_fd, head, sizeof(head) - 1);
+            if (link_fd >= 0) {
+                close(link_fd);
             }
-            globfree(&glob_buffer);
-        } else {
-            if (arg[0] == '$') {
-                args[position] = getenv(&(arg[1]));
-                if (args[position] == NULL) {
-                    args[position] = malloc(sizeof(char) * 2);
-                    args[position][0] = '\n';
-                    args[position][1] = '\0';
+            if (count > 8 && strncmp(head, "gitdir: ", 8) == 0) {
+                head[count] = '\0';
+                head[strcspn(head, "\n")] = '\0';
+                if (head[8] == '/') {
+                    snprintf(path, sizeof(path), "%s/HEAD", head + 8);
+                } else {
+                    snprintf(path, sizeof(path), "%s/%s/HEAD", base, head + 8);
                 }
+                fd = open(path, O_RDONLY | O_CLOEXEC);
+            }
+        }
+
+        if (fd >= 0) {
+            ssize_t count = read(fd, head, sizeof(head) - 1);
+            close(fd);
+            head[count > 0 ? count : 0] = '\0';
+            head[strcspn(head, "\n")] = '\0';
+            if (strncmp(head, "ref: refs/heads/", 16) == 0) {
+                snprintf(branch, PROMPT_BRANCH_LENGTH, "%.*s", PROMPT_BRANCH_LENGTH - 1, head + 16);
+            } else if (strncmp(head, "ref: ", 5) == 0) {
+                snprintf(branch, PROMPT_BRANCH_LENGTH, "%.*s", PROMPT_BRANCH_LENGTH - 1, head + 5);
             } else {
-                args[position] = arg;
+                snprintf(branch, PROMPT_BRANCH_LENGTH, "%.7s", head);
             }
-            position++;
+            return;
         }
-        arg = strtok(NULL, " \t\r\n\a");
-    }
-    // check if there was io redirection
-    // and to see how long the actual command is
-    int i = 0, argc = 0;
-    char* input_path = NULL;
-    char* output_path = NULL;
-    while (i < position) {
-        if (args[i][0] == '<' || args[i][0] == '>') {
-            break;
+
+        char* slash = strrchr(cur, '/');
+        if (slash == NULL || (slash == cur && cur[1] == '\0')) {
+            return;
         }
-        i++;
+        slash[slash == cur] = '\0';
     }
-    argc = i;
+}
 
-    // copy input/output paths
-    for(int j = i; j < position; j++) {
-        if (args[j][0] == '<') {
-            // input_path is the next arg
-            if (strlen(args[j]) == 1) {
-                input_path = calloc(strlen((args[j+1])) * sizeof(char), 1);
-                strcpy(input_path, args[j+1]);
-                j++;
-            }
-            // input path is part of this arg
-            else {
-                input_path = calloc(strlen(args[j]) * sizeof(char), 1);
-                strcpy(input_path, args[j] + 1);
-            }
-        } else if (args[j][0] == '>') {
-            // output path is the next arg
-            if (strlen(args[j]) == 1) {
-                output_path = calloc((strlen(args[j+1])) * sizeof(char), 1);
-                strcpy(output_path, args[j+1]);
-            }
-            // output path is part of this arg
-            else {
-                output_path = calloc(strlen(args[j]) * sizeof(char), 1);
-                strcpy(output_path, args[j]+1);
-            }
-        } else {
-            break;
+char* turtle_read() {
+    char* line = turtle_read_line();
+    if (line == NULL) {
+        return NULL;
+    }
+
+    // batch mode has nobody to recall commands, so it neither expands nor saves them
+    if (!shell->interactive) {
+        return line;
+    }
+
+    // !!, !n, !-n and !prefix are replaced by the commands they name before anything else sees the line
+    if (strchr(line, '!') != NULL) {
+        char* expanded = turtle_history_expand(line);
+        if (expanded == NULL) {
+            line[0] = '\0';
+            return line;
+        }
+        if (strcmp(expanded, line) != 0) {
+            printf("%s\n", expanded);
+            size_t length = strlen(expanded);
+            turtle_input.line_length = 0;
+            turtle_grow_line(length);
+            memcpy(turtle_input.line, expanded, length + 1);
+            turtle_input.line_length = length;
+            line = turtle_input.line;
         }
+        free(expanded);
     }
-    // null terminate the command to ignore io redirection
-    for (int j = argc; j <= position; j++) {
-        args[j] = NULL;
+
+    // save this string into the history while we still know its length
+    size_t length = turtle_input.line_length;
+    if (strspn(line, " \t\r\n\a") < length && strcmp(line, "history") != 0) {
+        turtle_history_add(line, length);
     }
 
-    struct Command* new_cmd = calloc(sizeof(struct Command), 1);
-    new_cmd->argv = args;
-    new_cmd->argc = argc;
-    new_cmd->input_path = input_path;
-    new_cmd->output_path = output_path;
-    new_cmd->pid = -1;
-    new_cmd->cmd_type = turtle_get_cmd_type(args[0]);
-    new_cmd->next = NULL;
-    return new_cmd;
+    return line;
 }
 
-enum command_type turtle_get_cmd_type(char* cmd_name) {
-    if (strcmp(cmd_name, "exit") == 0) {
-        return EXIT;
-    } else if (strcmp(cmd_name, "cd") == 0) {
-        return CD;
-    } else if (strcmp(cmd_name, "jobs") == 0) {
-        return JOBS;
-    } else if (strcmp(cmd_name, "fg") == 0) {
-        return FG;
-    } else if (strcmp(cmd_name, "bg") == 0) {
-        return BG;
-    } else if (strcmp(cmd_name, "kill") == 0) {
-        return KILL;
-    } else if (strcmp(cmd_name, "unset") == 0) {
-        return UNSET;
-    } else if (strcmp(cmd_name, "history") == 0) {
-        return HISTORY;
-    } else if (strcmp(cmd_name, "theme") == 0) {
-        return THEME;
-    } else if (strcmp(cmd_name, "help") == 0) {
-        return HELP;
-    } else if (strcmp(cmd_name, "turtlesay") == 0) {
-        return TURTLESAY;
+// open the history file and number the commands already in it
+// without a file, commands are still numbered and kept in the ring for this session
+void turtle_history_init() {
+    struct History* log = &turtle_history_log;
+    char path[MAX_PATH_LENGTH + 32];
+    if (getenv("TURTLE_HISTORY") != NULL) {
+        snprintf(path, sizeof(path), "%s", getenv("TURTLE_HISTORY"));
     } else {
-        return EXTERNAL;
+        snprintf(path, sizeof(path), "%s/.turtle_history", shell->pw_dir);
     }
-}
 
-int turtle_execute(struct Job* job) {
-    int exec_ret = 1, in_fd = 0, fd[2], job_id = -1;
-
-    if (job->root->cmd_type == EXTERNAL) {
-        job_id = turtle_insert_job(job);
+    log->size = HISTORY_RING;
+    log->offsets = malloc(log->size * sizeof(off_t));
+    log->fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (log->fd < 0) {
+        return;
     }
 
-    struct Command* cur_cmd = job->root;
-    while (cur_cmd != NULL) {
-        if (cur_cmd == job->root && cur_cmd->input_path != NULL) {
-            in_fd = open(cur_cmd->input_path, O_RDONLY);
-            if (in_fd < 0) {
-                printf("turtle found no such file or directory to read from: %s\n", cur_cmd->input_path);
-                turtle_remove_job(job_id);
-                return -1;
-            }
-        }
-        // identified piping
-        if (cur_cmd->next != NULL) {
-            pipe(fd);
-            exec_ret = turtle_execute_single(job, cur_cmd, in_fd, fd[1], PIPELINE);
-            close(fd[1]);
-            in_fd = fd[0];
+    // TURTLE_SHARED_HISTORY opts in to seeing other sessions' commands, through a segment next to
+    // the file unless it names one; joining before the file is read means nothing falls in between
+    char* share = getenv("TURTLE_SHARED_HISTORY");
+    if (share != NULL && share[0] != '\0' && strcmp(share, "0") != 0) {
+        if (strchr(share, '/') != NULL) {
+            turtle_history_share(share);
         } else {
-            int out_fd = 1;
-            if (cur_cmd->output_path != NULL) {
-                out_fd = open(cur_cmd->output_path, O_CREAT|O_WRONLY|O_TRUNC, 0x600);
-                if (out_fd < 0) {
-                    out_fd = 1;
-                }
-            }
-            exec_ret = turtle_execute_single(job, cur_cmd, in_fd, out_fd, job->mode_type);
+            strncat(path, ".shared", sizeof(path) - strlen(path) - 1);
+            turtle_history_share(path);
         }
+    }
 
-        cur_cmd = cur_cmd->next;
+    struct stat info;
+    if (fstat(log->fd, &info) < 0 || info.st_size == 0) {
+        return;
     }
+    log->file_start = info.st_size;
+    log->map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, log->fd, 0);
+    if (log->map == MAP_FAILED) {
+        log->map = NULL;
+        return;
+    }
+    log->map_size = info.st_size;
 
-    if (job->root->cmd_type == EXTERNAL) {
-        if (exec_ret >= 0 && job->mode_type == FOREGROUND) {
-            turtle_remove_job(job_id);
-        } else if (job->mode_type == BACKGROUND) {
-            turtle_print_process(job_id);
+    // every command ends in a newline, so the index is one memchr per command
+    char* cur = log->map;
+    char* end = log->map + log->map_size;
+    while (cur < end) {
+        if (log->count == log->size) {
+            log->size *= 2;
+            log->offsets = realloc(log->offsets, log->size * sizeof(off_t));
+        }
+        log->offsets[log->count++] = cur - log->map;
+        char* newline = memchr(cur, '\n', end - cur);
+        if (newline == NULL) {
+            // a shell that died mid-write left half a line; end it so the next command starts cleanly
+            turtle_write_all(log->fd, "\n", 1);
+            break;
         }
+        cur = newline + 1;
     }
-
-    return exec_ret;
 }
 
-int turtle_insert_job(struct Job* job) {
-    int id = -1;
+// append a command to the history file and number it, letting any sessions sharing history know
+void turtle_history_add(const char* text, size_t length) {
+    struct History* log = &turtle_history_log;
+    if (log->offsets == NULL) {
+        return;
+    }
 
-    for (int i = 1; i <= MAX_NUM_JOBS; i++) {
-        if (shell->jobs[i] == NULL) {
-            id = i;
-            break;
-        }
+    // one write keeps the command whole even with other shells appending to the same file,
+    // and the file position after an append is the end of exactly what we wrote
+    char* line = malloc(length + 1);
+    memcpy(line, text, length);
+    line[length] = '\n';
+    off_t offset = -1;
+    if (log->fd >= 0 && turtle_write_all(log->fd, line, length + 1) == 0) {
+        offset = lseek(log->fd, 0, SEEK_CUR) - (length + 1);
     }
-    
-    if (id < 0) {
-        return -1;
+    free(line);
+
+    turtle_history_keep(text, length, offset);
+    if (log->shared != NULL) {
+        turtle_history_publish(text, length, offset);
     }
-    
-    job->id = id;
-    shell->jobs[id] = job;
-    return id;
 }
 
-int turtle_remove_job(int id) {
-    if (id < 0 || id > MAX_NUM_JOBS || shell->jobs[id] == NULL) {
-        return -1;
+// number a command and keep it in the ring; offset is where it starts in the history file, or -1
+void turtle_history_keep(const char* text, size_t length, off_t offset) {
+    struct History* log = &turtle_history_log;
+    if (log->count == log->size) {
+        log->size *= 2;
+        log->offsets = realloc(log->offsets, log->size * sizeof(off_t));
     }
-    
-    // free all the memory associated with this job
-    struct Job* job = shell->jobs[id];
-    struct Command* temp;
-    struct Command* cur_cmd = job->root;
-    while (cur_cmd != NULL) {
-        temp = cur_cmd->next;
-        free(cur_cmd->argv);
-        free(cur_cmd->input_path);
-        free(cur_cmd->output_path);
-        free(cur_cmd);
-        cur_cmd = temp;
+    long slot = log->count % HISTORY_RING;
+    free(log->ring[slot]);
+    log->ring[slot] = malloc(length + 1);
+    memcpy(log->ring[slot], text, length);
+    log->ring[slot][length] = '\n';
+    log->ring_length[slot] = length;
+    log->offsets[log->count] = offset;
+    log->count++;
+
+    if (turtle_history_index.built) {
+        turtle_history_index_add(log->count, text, length);
     }
-    free(job);
+}
 
-    shell->jobs[id] = NULL;
+// map the segment at path that sessions sharing history publish to, creating it if this is the first
+void turtle_history_share(const char* path) {
+    struct History* log = &turtle_history_log;
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "turtle: cannot share history through %s: %s\n", path, strerror(errno));
+        return;
+    }
 
-    return 0;
+    // a new file reads as zeros, which is an empty ring; growing it to size is safe to race
+    struct stat info;
+    if (fstat(fd, &info) < 0 || (info.st_size < sizeof(struct Shared_History) && ftruncate(fd, sizeof(struct Shared_History)) < 0)) {
+        close(fd);
+        return;
+    }
+    struct Shared_History* shared = mmap(NULL, sizeof(struct Shared_History), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shared == MAP_FAILED) {
+        return;
+    }
+
+    uint64_t expected = 0;
+    __atomic_compare_exchange_n(&shared->magic, &expected, SHARED_HISTORY_MAGIC, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&shared->magic, __ATOMIC_ACQUIRE) != SHARED_HISTORY_MAGIC) {
+        fprintf(stderr, "turtle: %s is not a shared history segment\n", path);
+        munmap(shared, sizeof(struct Shared_History));
+        return;
+    }
+
+    // everything published before now is already in the history file we read
+    log->shared = shared;
+    log->shared_tail = __atomic_load_n(&shared->head, __ATOMIC_ACQUIRE);
 }
 
-int turtle_remove_process(int pid) {
-    struct Command* cur_cmd;
+// publish a command to the other sessions: reserve room with fetch_add, clear its seq, fill it in,
+// then store its seq last so nobody reads it half written
+void turtle_history_publish(const char* text, size_t length, off_t offset) {
+    struct Shared_History* shared = turtle_history_log.shared;
+    size_t size = (sizeof(struct Shared_Record) + length + SHARED_HISTORY_ALIGN - 1) & ~(size_t) (SHARED_HISTORY_ALIGN - 1);
+    if (size > SHARED_HISTORY_SIZE / 4) {
+        return;
+    }
+
+    while (1) {
+        uint64_t start = __atomic_fetch_add(&shared->head, size, __ATOMIC_ACQ_REL);
+        uint64_t position = start % SHARED_HISTORY_SIZE;
+        struct Shared_Record* record = (struct Shared_Record*) (shared->data + position);
+
+        // a reader still copying the record we are about to write over must see its seq change,
+        // so the old seq goes before any of the new fields do
+        __atomic_store_n(&record->seq, 0, __ATOMIC_RELEASE);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
 
-    for (int i = 1; i <= MAX_NUM_JOBS; i++) {
-        if (shell->jobs[i] == NULL) {
+        // records never wrap, so one that would is turned into padding and the room taken again;
+        // every record is a whole number of headers long, so there is always room for the padding's
+        if (position + size > SHARED_HISTORY_SIZE) {
+            record->length = SHARED_HISTORY_PAD;
+            record->offset = size;
+            __atomic_store_n(&record->seq, start + 1, __ATOMIC_RELEASE);
             continue;
         }
-        cur_cmd = shell->jobs[i]->root;
-        while (cur_cmd != NULL) {
-            if (cur_cmd->pid == pid) {
-                turtle_remove_job(i);
-                return 0;
+
+        record->length = length;
+        record->pid = getpid();
+        record->offset = offset;
+        memcpy(record->text, text, length);
+        __atomic_store_n(&record->seq, start + 1, __ATOMIC_RELEASE);
+        return;
+    }
+}
+
+// take in the commands other sessions published since the last prompt
+void turtle_history_sync() {
+    struct History* log = &turtle_history_log;
+    struct Shared_History* shared = log->shared;
+    if (shared == NULL) {
+        return;
+    }
+
+    uint64_t head = __atomic_load_n(&shared->head, __ATOMIC_ACQUIRE);
+    // so far behind that the ring has come round again, so what was missed is gone
+    if (head - log->shared_tail > SHARED_HISTORY_SIZE) {
+        log->shared_tail = head;
+    }
+
+    char* text = NULL;
+    while (log->shared_tail < head) {
+        uint64_t position = log->shared_tail % SHARED_HISTORY_SIZE;
+
+        // a session is still writing this one; wait for it, but not forever in case it died mid-write
+        struct Shared_Record* record = (struct Shared_Record*) (shared->data + position);
+        if (__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) != log->shared_tail + 1) {
+            time_t now = time(NULL);
+            if (log->shared_stalled == 0) {
+                log->shared_stalled = now;
+            } else if (now - log->shared_stalled >= SHARED_HISTORY_STALL) {
+                log->shared_tail = head;
+                log->shared_stalled = 0;
             }
-            cur_cmd = cur_cmd->next;
+            break;
         }
-    }
+        log->shared_stalled = 0;
 
-    // couldn't find the process to change its status of
-    return -1;
+        // padding covers everything its writer reserved, running on into the start of the ring
+        if (record->length == SHARED_HISTORY_PAD) {
+            log->shared_tail += record->offset;
+            continue;
+        }
+
+        // copy it out, then make sure nobody lapped the ring and wrote over it meanwhile
+        uint32_t length = record->length;
+        pid_t pid = record->pid;
+        off_t offset = record->offset;
+        size_t size = (sizeof(struct Shared_Record) + length + SHARED_HISTORY_ALIGN - 1) & ~(size_t) (SHARED_HISTORY_ALIGN - 1);
+        if (length > SHARED_HISTORY_SIZE - position - sizeof(struct Shared_Record)) {
+            log->shared_tail = head;
+            break;
+        }
+        text = realloc(text, length);
+        memcpy(text, record->text, length);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) != log->shared_tail + 1) {
+            log->shared_tail = __atomic_load_n(&shared->head, __ATOMIC_ACQUIRE);
+            break;
+        }
+        log->shared_tail += size;
+
+        // our own commands are already numbered, and ones in the file we read at startup too
+        if (pid != getpid() && (offset < 0 || offset >= log->file_start)) {
+            turtle_history_keep(text, length, offset);
+        }
+    }
+    free(text);
 }
 
-int turtle_print_process(int id) {
-    if (id < 0 || id > MAX_NUM_JOBS || shell->jobs[id] == NULL) {
-        return -1;
+// find command number (counting from 1) in the ring, or in the history file once it has left the ring
+// returns its text, which is not null terminated, or NULL if there is no such command
+const char* turtle_history_get(long number, size_t* length) {
+    struct History* log = &turtle_history_log;
+    if (number < 1 || number > log->count) {
+        return NULL;
     }
 
-    printf("[%d]", id);
+    long index = number - 1;
+    if (index >= log->count - HISTORY_RING && log->ring[index % HISTORY_RING] != NULL) {
+        *length = log->ring_length[index % HISTORY_RING];
+        return log->ring[index % HISTORY_RING];
+    }
 
-    struct Command* cur_cmd = shell->jobs[id]->root;
-    while (cur_cmd != NULL) {
-        printf(" %d", cur_cmd->pid);
-        cur_cmd = cur_cmd->next;
+    off_t offset = log->offsets[index];
+    if (offset < 0) {
+        return NULL;
     }
-    printf("\n");
 
-    return 0;
+    // the file only grows, so a command past the end of the map means mapping it again
+    if (offset >= log->map_size) {
+        struct stat info;
+        if (fstat(log->fd, &info) < 0 || offset >= info.st_size) {
+            return NULL;
+        }
+        if (log->map != NULL) {
+            munmap(log->map, log->map_size);
+        }
+        log->map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, log->fd, 0);
+        if (log->map == MAP_FAILED) {
+            log->map = NULL;
+            log->map_size = 0;
+            return NULL;
+        }
+        log->map_size = info.st_size;
+    }
+
+    char* start = log->map + offset;
+    char* newline = memchr(start, '\n', log->map_size - offset);
+    *length = newline != NULL ? newline - start : log->map_size - offset;
+    return start;
 }
 
-int turtle_execute_single(struct Job* job, struct Command* cmd, int in_fd, int out_fd, enum mode mode_type) {
-    cmd->status_type = RUNNING;
-    // check if the command is any of the builtins
-    if (cmd->cmd_type == EXIT) {
-        return turtle_exit();
-    } else if (cmd->cmd_type == CD) {
-        return turtle_cd(cmd->argc, cmd->argv);
-    } else if (cmd->cmd_type == JOBS) {
-        return turtle_jobs();
-    } else if (cmd->cmd_type == FG) {
-        return turtle_fg(cmd->argc, cmd->argv);
-    } else if (cmd->cmd_type == BG) {
-        return turtle_bg(cmd->argc, cmd->argv);
-    } else if (cmd->cmd_type == KILL) {
-        return turtle_kill(cmd->argc, cmd->argv);
-    } else if (cmd->cmd_type == UNSET) {
-        return turtle_unset(cmd->argc, cmd->argv);
-    } else if (cmd->cmd_type == HISTORY) {
-        return turtle_history();
-    } else if (cmd->cmd_type == THEME) {
-        return turtle_theme(cmd->argc, cmd->argv);
-    } else if (cmd->cmd_type == HELP) {
-        return turtle_help();
-    } else if (cmd->cmd_type == TURTLESAY) {
-        return turtlesay(cmd->argv);
+// find the newest command that starts with prefix
+// returns its number, or -1 if there is none
+long turtle_history_find(const char* prefix, size_t length) {
+    for (long number = turtle_history_log.count; number >= 1; number--) {
+        size_t command_length;
+        const char* command = turtle_history_get(number, &command_length);
+        if (command != NULL && command_length >= length && memcmp(command, prefix, length) == 0) {
+            return number;
+        }
     }
+    return -1;
+}
 
-    // check if the command is assigning a variable
-    for (int i = 0; i < strlen(cmd->argv[0]); i++) {
-        if (cmd->argv[0][i] == '=') {
-            putenv(cmd->argv[0]);
-            return 1;
-        }
+static uint64_t turtle_history_hash(const char* text, size_t length) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char) text[i]) * 1099511628211ULL;
     }
+    return hash;
+}
 
-    int exec_ret = 0;
-    pid_t child = fork();
+static uint32_t turtle_trigram(const char* text) {
+    return (unsigned char) text[0] | (unsigned char) text[1] << 8 | (unsigned char) text[2] << 16;
+}
 
+// find the slot of the list for this trigram, which is empty if no command contains it yet
+static struct Trigram_List* turtle_trigram_slot(struct Trigram_List* lists, long table_size, uint32_t trigram) {
+    long mask = table_size - 1;
+    long slot = (trigram * 2654435761U) & mask;
+    while (lists[slot].key != 0 && lists[slot].key != trigram + 1) {
+        slot = (slot + 1) & mask;
+    }
+    return &lists[slot];
+}
+
+// the text of a distinct command, looked up through the newest time it was entered
+static const char* turtle_history_unique_text(long id, size_t* length) {
+    return turtle_history_get(turtle_history_index.unique[id].last, length);
+}
+
+// index command number, or if the same command is already in the index, just move it up
+void turtle_history_index_add(long number, const char* text, size_t length) {
+    struct History_Index* index = &turtle_history_index;
+    uint64_t hash = turtle_history_hash(text, length);
+
+    long mask = index->unique_table_size - 1;
+    long slot = hash & mask;
+    while (index->unique_table[slot] != 0) {
+        long id = index->unique_table[slot] - 1;
+        size_t other_length;
+        const char* other = turtle_history_unique_text(id, &other_length);
+        if (index->unique[id].hash == hash && other != NULL && other_length == length && memcmp(other, text, length) == 0) {
+            index->unique[id].last = number;
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    if (index->unique_count == index->unique_size) {
+        index->unique_size *= 2;
+        index->unique = realloc(index->unique, index->unique_size * sizeof(struct History_Unique));
+    }
+    long id = index->unique_count++;
+    index->unique[id].hash = hash;
+    index->unique[id].last = number;
+    index->unique_table[slot] = id + 1;
+
+    // keep both tables at most half full so probes stay short
+    if (index->unique_count * 2 > index->unique_table_size) {
+        long* old_table = index->unique_table;
+        long old_size = index->unique_table_size;
+        index->unique_table_size *= 2;
+        index->unique_table = calloc(index->unique_table_size, sizeof(long));
+        mask = index->unique_table_size - 1;
+        for (long i = 0; i < old_size; i++) {
+            if (old_table[i] != 0) {
+                slot = index->unique[old_table[i] - 1].hash & mask;
+                while (index->unique_table[slot] != 0) {
+                    slot = (slot + 1) & mask;
+                }
+                index->unique_table[slot] = old_table[i];
+            }
+        }
+        free(old_table);
+    }
+
+    for (size_t i = 0; i + 3 <= length; i++) {
+        uint32_t trigram = turtle_trigram(text + i);
+        struct Trigram_List* list = turtle_trigram_slot(index->lists, index->list_table_size, trigram);
+        if (list->key == 0) {
+            list->key = trigram + 1;
+            index->list_count++;
+        }
+        // a trigram that shows up twice in one command is only listed once
+        if (list->count > 0 && list->ids[list->count - 1] == id) {
+            continue;
+        }
+        if (list->count == list->size) {
+            list->size = list->size == 0 ? 4 : list->size * 2;
+            list->ids = realloc(list->ids, list->size * sizeof(uint32_t));
+        }
+        list->ids[list->count++] = id;
+
+        if (index->list_count * 2 > index->list_table_size) {
+            struct Trigram_List* old_lists = index->lists;
+            long old_size = index->list_table_size;
+            index->list_table_size *= 2;
+            index->lists = calloc(index->list_table_size, sizeof(struct Trigram_List));
+            for (long j = 0; j < old_size; j++) {
+                if (old_lists[j].key != 0) {
+                    *turtle_trigram_slot(index->lists, index->list_table_size, old_lists[j].key - 1) = old_lists[j];
+                }
+            }
+            free(old_lists);
+        }
+    }
+}
+
+// index every command in the history so far
+void turtle_history_index_build() {
+    struct History_Index* index = &turtle_history_index;
+    index->unique_size = HISTORY_RING;
+    index->unique = malloc(index->unique_size * sizeof(struct History_Unique));
+    index->unique_table_size = HISTORY_RING * 2;
+    index->unique_table = calloc(index->unique_table_size, sizeof(long));
+    index->list_table_size = 4096;
+    index->lists = calloc(index->list_table_size, sizeof(struct Trigram_List));
+    index->built = 1;
+
+    for (long number = 1; number <= turtle_history_log.count; number++) {
+        size_t length;
+        const char* text = turtle_history_get(number, &length);
+        if (text != NULL) {
+            turtle_history_index_add(number, text, length);
+        }
+    }
+}
+
+// keep the ids in candidates that are also in list; both are in increasing order, so each search
+// only has to look past where the last one stopped
+static long turtle_history_intersect(uint32_t* candidates, long count, struct Trigram_List* list) {
+    long kept = 0, low = 0;
+    for (long i = 0; i < count; i++) {
+        long high = list->count;
+        while (low < high) {
+            long middle = (low + high) / 2;
+            if (list->ids[middle] < candidates[i]) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        if (low < list->count && list->ids[low] == candidates[i]) {
+            candidates[kept++] = candidates[i];
+        }
+    }
+    return kept;
+}
+
+static int turtle_history_compare_lists(const void* a, const void* b) {
+    uint32_t first = (*(struct Trigram_List**) a)->count, second = (*(struct Trigram_List**) b)->count;
+    return first < second ? -1 : first > second;
+}
+
+// put the numbers of the matches that start with text ahead of the rest, keeping each group newest first
+static void turtle_history_rank(const char* text, long* results, long found) {
+    size_t length = strlen(text);
+    long* rest = malloc(found * sizeof(long));
+    long first = 0, others = 0;
+    for (long i = 0; i < found; i++) {
+        size_t command_length;
+        const char* command = turtle_history_get(results[i], &command_length);
+        if (command != NULL && command_length >= length && memcmp(command, text, length) == 0) {
+            results[first++] = results[i];
+        } else {
+            rest[others++] = results[i];
+        }
+    }
+    memcpy(results + first, rest, others * sizeof(long));
+    free(rest);
+}
+
+// walk back from the newest command, which finds common text after looking at only a few
+// returns how many distinct matches were found, or -1 if the budget ran out first
+static long turtle_history_scan(const char* text, long* results, long max, long budget) {
+    size_t length = strlen(text);
+    long found = 0;
+
+    for (long number = turtle_history_log.count; number >= 1 && found < max; number--) {
+        if (budget-- == 0) {
+            return -1;
+        }
+        size_t command_length;
+        const char* command = turtle_history_get(number, &command_length);
+        if (command == NULL || memmem(command, command_length, text, length) == NULL) {
+            continue;
+        }
+
+        // a command entered again counts only where it was newest
+        int seen = 0;
+        for (long i = 0; i < found && !seen; i++) {
+            size_t other_length;
+            const char* other = turtle_history_get(results[i], &other_length);
+            seen = other != NULL && other_length == command_length && memcmp(other, command, command_length) == 0;
+        }
+        if (!seen) {
+            results[found++] = number;
+        }
+    }
+    return found;
+}
+
+// find the newest max distinct commands that contain text, with those that start with it first
+// returns how many numbers were put in results
+long turtle_history_search(const char* text, long* results, long max) {
+    struct History_Index* index = &turtle_history_index;
+    if (!index->built) {
+        turtle_history_index_build();
+    }
+
+    // a command can only contain text if it contains every trigram of text, so the candidates
+    // are the shortest list, less the commands missing from any other list
+    size_t length = strlen(text);
+    int trigrams = length >= 3 ? length - 2 : 0;
+    struct Trigram_List** lists = malloc((trigrams + 1) * sizeof(struct Trigram_List*));
+    for (int i = 0; i < trigrams; i++) {
+        lists[i] = turtle_trigram_slot(index->lists, index->list_table_size, turtle_trigram(text + i));
+        if (lists[i]->key == 0) {
+            free(lists);
+            return 0;
+        }
+    }
+    qsort(lists, trigrams, sizeof(struct Trigram_List*), turtle_history_compare_lists);
+
+    // text common enough to fill the results from the last few commands is found quickest there
+    long found = -1;
+    if (trigrams == 0 || (double) lists[0]->count / index->unique_count * HISTORY_SCAN_BUDGET > max * 2) {
+        found = turtle_history_scan(text, results, max, HISTORY_SCAN_BUDGET);
+    }
+    if (found >= 0) {
+        free(lists);
+        turtle_history_rank(text, results, found);
+        return found;
+    }
+
+    // intersecting the shortest lists first leaves the fewest candidates for the longer ones;
+    // text shorter than a trigram is checked against every distinct command
+    long count = trigrams > 0 ? lists[0]->count : index->unique_count;
+    uint32_t* candidates = malloc((count + 1) * sizeof(uint32_t));
+    for (long i = 0; i < count; i++) {
+        candidates[i] = trigrams > 0 ? lists[0]->ids[i] : i;
+    }
+    for (int i = 1; i < trigrams && count > 0; i++) {
+        count = turtle_history_intersect(candidates, count, lists[i]);
+    }
+
+    found = 0;
+    for (long i = 0; i < count; i++) {
+        // having all the trigrams is not the same as containing text, except for a single trigram
+        long number = index->unique[candidates[i]].last;
+        size_t command_length;
+        const char* command = turtle_history_get(number, &command_length);
+        if (command == NULL || (length != 3 && memmem(command, command_length, text, length) == NULL)) {
+            continue;
+        }
+
+        // keep the newest max in order as they are found
+        long place = found;
+        while (place > 0 && results[place - 1] < number) {
+            place--;
+        }
+        if (place >= max) {
+            continue;
+        }
+        long last = found < max ? found : max - 1;
+        memmove(results + place + 1, results + place, (last - place) * sizeof(long));
+        results[place] = number;
+        if (found < max) {
+            found++;
+        }
+    }
+
+    free(candidates);
+    free(lists);
+    turtle_history_rank(text, results, found);
+    return found;
+}
+
+// replace every history reference in line outside single quotes with the command it names
+// returns the new line, to be freed by the caller, or NULL if a reference names no command
+char* turtle_history_expand(const char* line) {
+    size_t size = strlen(line) + 1, used = 0;
+    char* expanded = malloc(size);
+    int quoted = 0;
+
+    for (const char* cur = line; *cur != '\0'; cur++) {
+        const char* command = NULL;
+        size_t command_length = 0;
+        const char* end = cur + 1;
+
+        if (*cur == '\'') {
+            quoted = !quoted;
+        } else if (*cur == '!' && !quoted && cur[1] != '\0' && !isspace((unsigned char) cur[1]) && cur[1] != '=') {
+            long number = -1;
+            if (cur[1] == '!') {
+                number = turtle_history_log.count;
+                end = cur + 2;
+            } else if (isdigit((unsigned char) cur[1]) || (cur[1] == '-' && isdigit((unsigned char) cur[2]))) {
+                char* number_end;
+                number = strtol(cur + 1, &number_end, 10);
+                if (number < 0) {
+                    number += turtle_history_log.count + 1;
+                }
+                end = number_end;
+            } else {
+                end = cur + 1 + strcspn(cur + 1, " \t|&<>;");
+                number = turtle_history_find(cur + 1, end - cur - 1);
+            }
+
+            command = turtle_history_get(number, &command_length);
+            if (command == NULL) {
+                fprintf(stderr, "turtle: %.*s: event not found\n", (int) (end - cur), cur);
+                free(expanded);
+                return NULL;
+            }
+        }
+
+        if (command == NULL) {
+            command = cur;
+            command_length = 1;
+        }
+        if (used + command_length + 1 > size) {
+            size = (used + command_length + 1) * 2;
+            expanded = realloc(expanded, size);
+        }
+        memcpy(expanded + used, command, command_length);
+        used += command_length;
+        cur = end - 1;
+    }
+
+    expanded[used] = '\0';
+    return expanded;
+}
+
+// make room for at least extra more characters in the line buffer
+void turtle_grow_line(size_t extra) {
+    struct Input_Reader* in = &turtle_input;
+    if (in->line_length + extra < in->line_size) {
+        return;
+    }
+
+    // double the buffer so long lines only cost a logarithmic number of reallocs
+    while (in->line_length + extra >= in->line_size) {
+        in->line_size *= 2;
+    }
+    in->line = realloc(in->line, in->line_size);
+
+    // make sure we had a successful malloc
+    if (!in->line) {
+        fprintf(stderr, "turtle failed to read\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// read one logical line, joining lines that end in a backslash
+// input is pulled in large blocks and the line buffer is reused across prompts,
+// so the returned string is only valid until the next call
+char* turtle_read_line() {
+    struct Input_Reader* in = &turtle_input;
+    if (turtle_editor.enabled && in->fd == STDIN_FILENO) {
+        return turtle_edit_line();
+    }
+    if (in->prompt != NULL) {
+        fflush(stdout);
+        turtle_write_all(STDOUT_FILENO, in->prompt, strlen(in->prompt));
+        in->prompt = NULL;
+    }
+    in->line_length = 0;
+
+    while (1) {
+        // refill the block once everything in it has been consumed
+        if (in->block_start == in->block_end) {
+            fflush(stdout);
+
+            // reap background jobs while waiting for the next line
+            if (in->fd >= 0 && turtle_wait_input(in->fd) < 0) {
+                in->line_length = 0;
+                break;
+            }
+
+            ssize_t count = in->fd < 0 ? 0 : read(in->fd, in->block, READ_BLOCK);
+            if (count < 0 && errno == EINTR) {
+                // ctrl-c throws away whatever was typed so far
+                in->line_length = 0;
+                break;
+            }
+            if (count <= 0) {
+                if (in->line_length == 0) {
+                    return NULL;
+                }
+                break;
+            }
+            in->block_start = 0;
+            in->block_end = count;
+        }
+
+        // copy everything up to the next newline in one go
+        char* start = in->block + in->block_start;
+        size_t available = in->block_end - in->block_start;
+        char* newline = memchr(start, '\n', available);
+        size_t take = newline != NULL ? newline - start : available;
+
+        turtle_grow_line(take);
+        memcpy(in->line + in->line_length, start, take);
+        in->line_length += take;
+        in->block_start += take;
+
+        if (newline == NULL) {
+            continue;
+        }
+        in->block_start++;
+
+        // be able to handle multiple lines of input
+        if (in->line_length > 0 && in->line[in->line_length - 1] == '\\') {
+            in->line_length--;
+            if (shell->interactive) {
+                printf("> ");
+            }
+            continue;
+        }
+        break;
+    }
+
+    in->line[in->line_length] = '\0';
+    return in->line;
+}
+
+// block until fd has input, reaping any children that finish in the meantime
+// returns -1 if we were interrupted by a signal such as ctrl-c
+int turtle_wait_input(int fd) {
+    struct pollfd fds[2];
+    fds[0].fd = fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = shell->child_fd;
+    fds[1].events = POLLIN;
+
+    while (1) {
+        fds[0].revents = 0;
+        fds[1].revents = 0;
+        if (poll(fds, shell->child_fd >= 0 ? 2 : 1, -1) < 0) {
+            if (errno == EINTR) {
+                return -1;
+            }
+            return 0;
+        }
+        if (fds[1].revents & POLLIN) {
+            turtle_check_children();
+        }
+        if (fds[0].revents != 0) {
+            return 0;
+        }
+    }
+}
+
+// put the terminal's settings aside so each line can be edited in raw mode and commands get them back
+void turtle_editor_init() {
+    struct Line_Editor* ed = &turtle_editor;
+    const char* term = getenv("TERM");
+    if (term != NULL && strcmp(term, "dumb") == 0) {
+        return;
+    }
+    if (tcgetattr(STDIN_FILENO, &ed->cooked) < 0) {
+        return;
+    }
+
+    // signals stay on so ctrl-c still interrupts the read, and output processing stays on so \n starts a line
+    ed->raw = ed->cooked;
+    ed->raw.c_iflag &= ~(ICRNL | IXON | BRKINT | INPCK | ISTRIP);
+    ed->raw.c_lflag &= ~(ECHO | ICANON | IEXTEN);
+    ed->raw.c_cc[VMIN] = 1;
+    ed->raw.c_cc[VTIME] = 0;
+    ed->enabled = 1;
+}
+
+// next byte typed, taken from the same block as buffered input so typeahead survives between lines
+int turtle_edit_byte() {
+    struct Input_Reader* in = &turtle_input;
+    if (in->block_start == in->block_end) {
+        fflush(stdout);
+        if (turtle_wait_input(in->fd) < 0) {
+            return EDIT_INTERRUPT;
+        }
+        ssize_t count = read(in->fd, in->block, READ_BLOCK);
+        if (count < 0 && errno == EINTR) {
+            return EDIT_INTERRUPT;
+        }
+        if (count <= 0) {
+            return EDIT_EOF;
+        }
+        in->block_start = 0;
+        in->block_end = count;
+    }
+    return (unsigned char) in->block[in->block_start++];
+}
+
+// next key typed, with the escape sequences terminals send for arrows and friends decoded
+int turtle_edit_key() {
+    int c = turtle_edit_byte();
+    if (c != '\033') {
+        return c;
+    }
+    c = turtle_edit_byte();
+    if (c < 0 || (c != '[' && c != 'O')) {
+        return c < 0 ? c : EDIT_ALT + c;
+    }
+
+    // ESC [ params final, where ctrl or alt with an arrow shows up as a second parameter
+    int params[2] = {0, 0};
+    int count = 0;
+    while ((c = turtle_edit_byte()) >= 0x30 && c <= 0x3f) {
+        if (c == ';') {
+            count++;
+        } else if (isdigit(c) && count < 2) {
+            params[count] = params[count] * 10 + c - '0';
+        }
+    }
+    int word = params[1] == 3 || params[1] == 5;
+    switch (c) {
+        case 'A': return EDIT_UP;
+        case 'B': return EDIT_DOWN;
+        case 'C': return word ? EDIT_ALT + 'f' : EDIT_RIGHT;
+        case 'D': return word ? EDIT_ALT + 'b' : EDIT_LEFT;
+        case 'H': return EDIT_HOME;
+        case 'F': return EDIT_END;
+        case '~':
+            if (params[0] == 1 || params[0] == 7) {
+                return EDIT_HOME;
+            } else if (params[0] == 4 || params[0] == 8) {
+                return EDIT_END;
+            } else if (params[0] == 3) {
+                return EDIT_DELETE;
+            }
+            return EDIT_NONE;
+        default:
+            return c < 0 ? c : EDIT_NONE;
+    }
+}
+
+// columns text takes on screen, skipping colour escapes and counting each utf-8 character once
+int turtle_edit_width(const char* text, size_t length) {
+    int width = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] == '\033' && i + 1 < length && text[i + 1] == '[') {
+            i += 2;
+            while (i < length && !isalpha((unsigned char) text[i])) {
+                i++;
+            }
+        } else if (text[i] == '\n') {
+            width = 0;
+        } else if ((text[i] & 0xc0) != 0x80) {
+            width++;
+        }
+    }
+    return width;
+}
+
+// redraw the line after the prompt in one write, scrolling it sideways rather than wrapping
+// so the cursor can always be put back with a carriage return and a single move right
+void turtle_edit_refresh() {
+    struct Line_Editor* ed = &turtle_editor;
+    struct Input_Reader* in = &turtle_input;
+    char* text = in->line + ed->start;
+    size_t length = in->line_length - ed->start;
+
+    struct winsize window;
+    int columns = ioctl(STDOUT_FILENO, TIOCGWINSZ, &window) == 0 && window.ws_col > 0 ? window.ws_col : 80;
+    int prompt_column = ed->prompt_width % columns;
+    int room = columns - prompt_column - 1;
+    if (room < 1) {
+        room = 1;
+    }
+
+    if (ed->cursor < ed->scroll) {
+        ed->scroll = ed->cursor;
+    }
+    while (turtle_edit_width(text + ed->scroll, ed->cursor - ed->scroll) > room) {
+        do {
+            ed->scroll++;
+        } while ((text[ed->scroll] & 0xc0) == 0x80);
+    }
+    size_t end = ed->scroll;
+    for (int width = 0; end < length; end++) {
+        if ((text[end] & 0xc0) != 0x80 && width++ == room) {
+            break;
+        }
+    }
+
+    if (ed->screen_size < end - ed->scroll + 64) {
+        ed->screen_size = end - ed->scroll + 64;
+        ed->screen = realloc(ed->screen, ed->screen_size);
+    }
+    int used = snprintf(ed->screen, ed->screen_size, prompt_column > 0 ? "\r\033[%dC" : "\r", prompt_column);
+    memcpy(ed->screen + used, text + ed->scroll, end - ed->scroll);
+    used += end - ed->scroll;
+    int cursor_column = prompt_column + turtle_edit_width(text + ed->scroll, ed->cursor - ed->scroll);
+    used += snprintf(ed->screen + used, ed->screen_size - used, cursor_column > 0 ? "\033[K\r\033[%dC" : "\033[K\r", cursor_column);
+
+    fflush(stdout);
+    turtle_write_all(STDOUT_FILENO, ed->screen, used);
+}
+
+// start over on a fresh line, as after a listing or a search took over the screen
+void turtle_edit_redraw() {
+    printf("\r\033[K%s", turtle_editor.prompt);
+    turtle_edit_refresh();
+}
+
+void turtle_edit_insert(const char* text, size_t length) {
+    struct Line_Editor* ed = &turtle_editor;
+    struct Input_Reader* in = &turtle_input;
+    turtle_grow_line(length);
+    char* at = in->line + ed->start + ed->cursor;
+    memmove(at + length, at, in->line_length - ed->start - ed->cursor);
+    memcpy(at, text, length);
+    in->line_length += length;
+    ed->cursor += length;
+}
+
+// remove the bytes of the line between from and to, keeping the cursor on the same text
+void turtle_edit_delete(size_t from, size_t to) {
+    struct Line_Editor* ed = &turtle_editor;
+    struct Input_Reader* in = &turtle_input;
+    char* text = in->line + ed->start;
+    memmove(text + from, text + to, in->line_length - ed->start - to);
+    in->line_length -= to - from;
+    if (ed->cursor >= to) {
+        ed->cursor -= to - from;
+    } else if (ed->cursor > from) {
+        ed->cursor = from;
+    }
+}
+
+// delete text but keep it for ctrl-y
+void turtle_edit_kill(size_t from, size_t to) {
+    struct Line_Editor* ed = &turtle_editor;
+    if (from == to) {
+        return;
+    }
+    ed->kill = realloc(ed->kill, to - from);
+    memcpy(ed->kill, turtle_input.line + ed->start + from, to - from);
+    ed->kill_length = to - from;
+    turtle_edit_delete(from, to);
+}
+
+void turtle_edit_replace(const char* text, size_t length) {
+    turtle_input.line_length = turtle_editor.start;
+    turtle_editor.cursor = 0;
+    turtle_edit_insert(text, length);
+}
+
+// show a command from history in place of the line, or the line being typed again past the newest
+void turtle_edit_recall(long number) {
+    struct Line_Editor* ed = &turtle_editor;
+    struct Input_Reader* in = &turtle_input;
+    if (number > turtle_history_log.count) {
+        if (ed->recall != 0) {
+            turtle_edit_replace(ed->draft, strlen(ed->draft));
+            ed->recall = 0;
+        }
+        return;
+    }
+
+    size_t length;
+    const char* command = turtle_history_get(number, &length);
+    if (command == NULL) {
+        printf("\a");
+        return;
+    }
+    if (ed->recall == 0) {
+        free(ed->draft);
+        ed->draft = strndup(in->line + ed->start, in->line_length - ed->start);
+    }
+    turtle_edit_replace(command, length);
+    ed->recall = number;
+}
+
+// ctrl-r: look through history for the text typed so far, newest and prefix matches first
+// returns the key that ended the search so the editor can act on it, or EDIT_NONE if it was used up
+int turtle_edit_search() {
+    struct Line_Editor* ed = &turtle_editor;
+    char text[SEARCH_LENGTH];
+    size_t text_length = 0;
+    long results[HISTORY_MATCHES];
+    long found = 0, pick = 0;
+
+    while (1) {
+        size_t length = 0;
+        const char* match = found > 0 ? turtle_history_get(results[pick], &length) : "";
+        if (match == NULL) {
+            match = "";
+        }
+        printf("\r\033[K(search)'%.*s': %.*s", (int) text_length, text, (int) strcspn(match, "\n"), match);
+
+        int key = turtle_edit_key();
+        if (key == 7 || key == EDIT_INTERRUPT || key == EDIT_EOF) {
+            turtle_edit_redraw();
+            return EDIT_NONE;
+        } else if (key == 18) {
+            if (pick + 1 < found) {
+                pick++;
+            } else {
+                printf("\a");
+            }
+            continue;
+        } else if (key == 127 || key == 8) {
+            while (text_length > 0 && (text[--text_length] & 0xc0) == 0x80) {
+            }
+        } else if ((key >= 32 && key < 127) || (key >= 128 && key < 256)) {
+            if (text_length + 1 < sizeof(text)) {
+                text[text_length++] = key;
+            }
+        } else {
+            // anything else takes the match as the line and goes on to do what it usually does
+            if (found > 0) {
+                turtle_edit_replace(match, length);
+                ed->recall = 0;
+            }
+            turtle_edit_redraw();
+            return key;
+        }
+
+        text[text_length] = '\0';
+        found = text_length > 0 ? turtle_history_search(text, results, HISTORY_MATCHES) : 0;
+        pick = 0;
+    }
+}
+
+// read a line from the terminal in raw mode with emacs keys, history and tab completion
+// returns the joined line just as turtle_read_line does, or NULL at the end of input
+char* turtle_edit_line() {
+    struct Line_Editor* ed = &turtle_editor;
+    struct Input_Reader* in = &turtle_input;
+    in->line_length = 0;
+    ed->start = 0;
+    ed->prompt = in->prompt != NULL ? in->prompt : "";
+    in->prompt = NULL;
+
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &ed->raw);
+    int pending = EDIT_NONE;
+    int end_of_input = 0;
+
+    // every line, including the ones a trailing backslash continues, starts here
+    while (1) {
+        ed->prompt_width = turtle_edit_width(ed->prompt, strlen(ed->prompt));
+        ed->cursor = 0;
+        ed->scroll = 0;
+        ed->recall = 0;
+        ed->tabs = 0;
+        fflush(stdout);
+        turtle_write_all(STDOUT_FILENO, ed->prompt, strlen(ed->prompt));
+
+        int done = 0;
+        while (!done) {
+            // a paste arrives all at once, so the line is only redrawn once it has been taken in
+            if (pending == EDIT_NONE && in->block_start == in->block_end) {
+                turtle_edit_refresh();
+            }
+            int key = pending != EDIT_NONE ? pending : turtle_edit_key();
+            pending = EDIT_NONE;
+            char* text = in->line + ed->start;
+            size_t length = in->line_length - ed->start;
+            size_t at = ed->cursor;
+            ed->tabs = key == '\t' ? ed->tabs + 1 : 0;
+
+            switch (key) {
+                case EDIT_NONE:
+                    break;
+                case EDIT_INTERRUPT:
+                    // the handler has already moved to a new line, and the line is thrown away
+                    in->line_length = 0;
+                    ed->start = 0;
+                    done = 2;
+                    break;
+                case EDIT_EOF:
+                case 4:
+                    if (in->line_length == 0) {
+                        end_of_input = 1;
+                        done = 2;
+                    } else if (key == EDIT_EOF) {
+                        done = 1;
+                    } else if (at < length) {
+                        while (++at < length && (text[at] & 0xc0) == 0x80) {
+                        }
+                        turtle_edit_delete(ed->cursor, at);
+                    }
+                    break;
+                case EDIT_DELETE:
+                    if (at < length) {
+                        while (++at < length && (text[at] & 0xc0) == 0x80) {
+                        }
+                        turtle_edit_delete(ed->cursor, at);
+                    }
+                    break;
+                case '\r':
+                case '\n':
+                    done = 1;
+                    break;
+                case 1:
+                case EDIT_HOME:
+                    ed->cursor = 0;
+                    break;
+                case 5:
+                case EDIT_END:
+                    ed->cursor = length;
+                    break;
+                case 2:
+                case EDIT_LEFT:
+                    while (ed->cursor > 0 && (text[--ed->cursor] & 0xc0) == 0x80) {
+                    }
+                    break;
+                case 6:
+                case EDIT_RIGHT:
+                    while (ed->cursor < length && (text[++ed->cursor] & 0xc0) == 0x80) {
+                    }
+                    break;
+                case 127:
+                case 8:
+                    while (at > 0 && (text[--at] & 0xc0) == 0x80) {
+                    }
+                    turtle_edit_delete(at, ed->cursor);
+                    break;
+                case 11:
+                    turtle_edit_kill(at, length);
+                    break;
+                case 21:
+                    turtle_edit_kill(0, at);
+                    break;
+                case 23:
+                    while (at > 0 && isspace((unsigned char) text[at - 1])) {
+                        at--;
+                    }
+                    while (at > 0 && !isspace((unsigned char) text[at - 1])) {
+                        at--;
+                    }
+                    turtle_edit_kill(at, ed->cursor);
+                    break;
+                case 25:
+                    if (ed->kill_length > 0) {
+                        turtle_edit_insert(ed->kill, ed->kill_length);
+                    }
+                    break;
+                case 20:
+                    // swap the two bytes around the cursor, the way most people fix a typo
+                    if (length >= 2 && at > 0) {
+                        if (at == length) {
+                            at--;
+                        }
+                        char swap = text[at - 1];
+                        text[at - 1] = text[at];
+                        text[at] = swap;
+                        ed->cursor = at + 1;
+                    }
+                    break;
+                case 12:
+                    printf("\033[H\033[2J");
+                    turtle_edit_redraw();
+                    break;
+                case 16:
+                case EDIT_UP:
+                    if (ed->recall != 1 && turtle_history_log.count > 0) {
+                        turtle_edit_recall(ed->recall == 0 ? turtle_history_log.count : ed->recall - 1);
+                    }
+                    break;
+                case 14:
+                case EDIT_DOWN:
+                    if (ed->recall != 0) {
+                        turtle_edit_recall(ed->recall + 1);
+                    }
+                    break;
+                case 18:
+                    pending = turtle_edit_search();
+                    break;
+                case '\t':
+                    turtle_edit_complete();
+                    break;
+                case EDIT_ALT + 'b':
+                    while (at > 0 && !isalnum((unsigned char) text[at - 1])) {
+                        at--;
+                    }
+                    while (at > 0 && isalnum((unsigned char) text[at - 1])) {
+                        at--;
+                    }
+                    ed->cursor = at;
+                    break;
+                case EDIT_ALT + 'f':
+                case EDIT_ALT + 'd':
+                    while (at < length && !isalnum((unsigned char) text[at])) {
+                        at++;
+                    }
+                    while (at < length && isalnum((unsigned char) text[at])) {
+                        at++;
+                    }
+                    if (key == EDIT_ALT + 'd') {
+                        turtle_edit_kill(ed->cursor, at);
+                    } else {
+                        ed->cursor = at;
+                    }
+                    break;
+                case EDIT_ALT + 127:
+                    while (at > 0 && !isalnum((unsigned char) text[at - 1])) {
+                        at--;
+                    }
+                    while (at > 0 && isalnum((unsigned char) text[at - 1])) {
+                        at--;
+                    }
+                    turtle_edit_kill(at, ed->cursor);
+                    break;
+                default:
+                    if ((key >= 32 && key < 127) || (key >= 128 && key < 256)) {
+                        char byte = key;
+                        turtle_edit_insert(&byte, 1);
+                    }
+                    break;
+            }
+        }
+
+        if (done == 2) {
+            break;
+        }
+
+        // show the whole line once more before moving past it
+        ed->cursor = in->line_length - ed->start;
+        turtle_edit_refresh();
+        printf("\n");
+
+        // a trailing backslash carries on into another line, just as in turtle_read_line
+        if (in->line_length > ed->start && in->line[in->line_length - 1] == '\\') {
+            in->line_length--;
+            ed->start = in->line_length;
+            ed->prompt = "> ";
+            continue;
+        }
+        break;
+    }
+
+    fflush(stdout);
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &ed->cooked);
+    if (end_of_input) {
+        return NULL;
+    }
+    in->line[in->line_length] = '\0';
+    return in->line;
+}
+
+// tab: finish the word under the cursor as a command, a path or a $VARIABLE, whichever fits where it is;
+// a second tab in a row lists the matches when there is nothing more they all agree on
+void turtle_edit_complete() {
+    struct Line_Editor* ed = &turtle_editor;
+    char* text = turtle_input.line + ed->start;
+
+    // the word runs back to the last space or operator that is not escaped
+    size_t word_start = ed->cursor;
+    while (word_start > 0) {
+        char c = text[word_start - 1];
+        if (word_start >= 2 && text[word_start - 2] == '\\') {
+            word_start -= 2;
+        } else if (isspace((unsigned char) c) || strchr("|&;<>()", c) != NULL) {
+            break;
+        } else {
+            word_start--;
+        }
+    }
+
+    char word[MAX_PATH_LENGTH];
+    size_t word_length = 0;
+    int quoted = word_start < ed->cursor && (text[word_start] == '\'' || text[word_start] == '"');
+    // inserting can move the line, and text with it, so the quote that closes the word is kept aside
+    char quote = quoted ? text[word_start] : '\0';
+    for (size_t i = word_start + quoted; i < ed->cursor && word_length + 1 < sizeof(word); i++) {
+        if (text[i] == '\\' && !quoted && i + 1 < ed->cursor) {
+            i++;
+        }
+        word[word_length++] = text[i];
+    }
+    word[word_length] = '\0';
+
+    enum complete_kind kind = COMPLETE_PATH;
+    if (word[0] == '$') {
+        kind = COMPLETE_VARIABLE;
+    } else if (!quoted && strchr(word, '/') == NULL && turtle_complete_in_command(text, word_start)) {
+        kind = COMPLETE_COMMAND;
+    }
+
+    struct Completion found;
+    turtle_complete(word, kind, &found);
+    if (found.aborted) {
+        turtle_complete_free(&found);
+        return;
+    }
+    if (found.count == 0) {
+        printf("\a");
+        turtle_complete_free(&found);
+        return;
+    }
+
+    // put in whatever every match agrees on, escaped so it reads back as the same word
+    size_t inserted = 0;
+    for (size_t i = found.typed; i < found.common_length; i++) {
+        char c = found.common[i];
+        if (!quoted && strchr(" \t\\'\"|&;<>()$*?[]#{}`!", c) != NULL) {
+            turtle_edit_insert("\\", 1);
+        }
+        turtle_edit_insert(&c, 1);
+        inserted++;
+    }
+
+    if (found.count == 1) {
+        if (kind == COMPLETE_PATH && found.dirs[0]) {
+            turtle_edit_insert("/", 1);
+        } else if (kind != COMPLETE_VARIABLE) {
+            if (quoted) {
+                turtle_edit_insert(&quote, 1);
+            }
+            turtle_edit_insert(" ", 1);
+        }
+    } else if (inserted == 0 && ed->tabs >= 2) {
+        printf("\n");
+        turtle_complete_list(&found);
+        turtle_edit_redraw();
+    } else if (inserted == 0) {
+        printf("\a");
+    }
+    turtle_complete_free(&found);
+}
+
+// whether a word starting at at names the command to run: first on the line, after an operator,
+// or after a prefix like time that runs the rest of the line
+int turtle_complete_in_command(const char* text, size_t at) {
+    while (at > 0 && isspace((unsigned char) text[at - 1])) {
+        at--;
+    }
+    if (at == 0 || strchr("|&;(", text[at - 1]) != NULL) {
+        return 1;
+    }
+
+    size_t end = at;
+    while (at > 0 && !isspace((unsigned char) text[at - 1]) && strchr("|&;()<>", text[at - 1]) == NULL) {
+        at--;
+    }
+    if ((end - at == 4 && strncmp(text + at, "time", 4) == 0) || (end - at == 5 && strncmp(text + at, "meter", 5) == 0)) {
+        return turtle_complete_in_command(text, at);
+    }
+
+    // pipesize takes a size before the command
+    size_t size_start = at;
+    while (at > 0 && isspace((unsigned char) text[at - 1])) {
+        at--;
+    }
+    if (at >= 8 && strncmp(text + at - 8, "pipesize", 8) == 0 && size_start > at) {
+        return turtle_complete_in_command(text, at - 8);
+    }
+    return 0;
+}
+
+// gather the matches for a word that has already been unescaped
+void turtle_complete(const char* word, enum complete_kind kind, struct Completion* found) {
+    memset(found, 0, sizeof(*found));
+    found->kind = kind;
+    if (kind == COMPLETE_COMMAND) {
+        turtle_complete_commands(word, found);
+    } else if (kind == COMPLETE_PATH) {
+        turtle_complete_paths(word, found);
+    } else {
+        // variables are matched without their $ and put back after it
+        size_t length = strlen(word + 1);
+        found->typed = length;
+        for (char** variable = environ; *variable != NULL; variable++) {
+            char* equals = strchr(*variable, '=');
+            if (equals != NULL && (size_t) (equals - *variable) >= length && strncmp(*variable, word + 1, length) == 0) {
+                turtle_complete_add(found, *variable, equals - *variable, 0);
+            }
+        }
+    }
+}
+
+// count a match, keeping it to list if there is room and narrowing what all the matches share
+void turtle_complete_add(struct Completion* found, const char* name, size_t length, int dir) {
+    if (found->count < COMPLETE_LIST) {
+        found->names[found->count] = strndup(name, length);
+        found->dirs[found->count] = dir;
+    }
+    if (found->count == 0) {
+        found->common = strndup(name, length);
+        found->common_length = length;
+    } else {
+        size_t shared = 0;
+        while (shared < found->common_length && shared < length && found->common[shared] == name[shared]) {
+            shared++;
+        }
+        found->common_length = shared;
+    }
+    found->count++;
+}
+
+void turtle_complete_free(struct Completion* found) {
+    for (long i = 0; i < found->count && i < COMPLETE_LIST; i++) {
+        free(found->names[i]);
+    }
+    free(found->common);
+}
+
+int turtle_complete_compare(const void* a, const void* b) {
+    return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+// print the kept matches in columns across the terminal, sorted, with directories marked by a slash
+void turtle_complete_list(struct Completion* found) {
+    long shown = found->count < COMPLETE_LIST ? found->count : COMPLETE_LIST;
+    for (long i = 0; i < shown; i++) {
+        if (found->dirs[i]) {
+            size_t length = strlen(found->names[i]);
+            found->names[i] = realloc(found->names[i], length + 2);
+            strcpy(found->names[i] + length, "/");
+        }
+    }
+    qsort(found->names, shown, sizeof(char*), turtle_complete_compare);
+
+    int widest = 1;
+    for (long i = 0; i < shown; i++) {
+        int width = turtle_edit_width(found->names[i], strlen(found->names[i]));
+        if (width > widest) {
+            widest = width;
+        }
+    }
+    struct winsize window;
+    int columns = ioctl(STDOUT_FILENO, TIOCGWINSZ, &window) == 0 && window.ws_col > 0 ? window.ws_col : 80;
+    long per_row = columns / (widest + 2) > 0 ? columns / (widest + 2) : 1;
+    long rows = (shown + per_row - 1) / per_row;
+
+    for (long row = 0; row < rows; row++) {
+        for (long i = row; i < shown; i += rows) {
+            int width = turtle_edit_width(found->names[i], strlen(found->names[i]));
+            printf("%s%*s", found->names[i], i + rows < shown ? widest + 2 - width : 0, "");
+        }
+        printf("\n");
+    }
+    if (found->count > shown) {
+        printf("... and %ld more\n", found->count - shown);
+    }
+}
+
+// match the last part of a path against its directory, read a chunk at a time with getdents64
+// so that a huge directory neither holds up the next key nor needs all its names in memory at once
+void turtle_complete_paths(const char* word, struct Completion* found) {
+    const char* slash = strrchr(word, '/');
+    const char* base = slash != NULL ? slash + 1 : word;
+    size_t base_length = strlen(base);
+    found->typed = base_length;
+
+    char dir[MAX_PATH_LENGTH + 2];
+    if (slash == NULL) {
+        strcpy(dir, ".");
+    } else if (word[0] == '~' && (word + 1 == slash || word[1] == '/')) {
+        snprintf(dir, sizeof(dir), "%s%.*s", shell->pw_dir, (int) (slash - word), word + 1);
+    } else {
+        snprintf(dir, sizeof(dir), "%.*s", (int) (slash - word + 1), word);
+    }
+    int dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0) {
+        return;
+    }
+
+    char* buffer = malloc(COMPLETE_READ);
+    struct Input_Reader* in = &turtle_input;
+    ssize_t count;
+    for (int chunk = 0; (count = getdents64(dir_fd, buffer, COMPLETE_READ)) > 0; chunk++) {
+        // give up as soon as another key arrives, the user has moved on; only checked once there
+        // is more to read, so a listing that was already whole is never thrown away
+        struct pollfd key = {in->fd, POLLIN, 0};
+        if (chunk > 0 && turtle_editor.enabled && (in->block_start < in->block_end || poll(&key, 1, 0) > 0)) {
+            found->aborted = 1;
+            break;
+        }
+
+        for (ssize_t at = 0; at < count; ) {
+            struct dirent64* entry = (struct dirent64*) (buffer + at);
+            at += entry->d_reclen;
+            const char* name = entry->d_name;
+            if (strncmp(name, base, base_length) != 0 || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+                continue;
+            }
+            // hidden files only come up when the word asks for them
+            if (name[0] == '.' && base[0] != '.') {
+                continue;
+            }
+
+            // only the matches that might be listed or finished need their type settled
+            int is_dir = entry->d_type == DT_DIR;
+            if ((entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN) && found->count < COMPLETE_LIST) {
+                struct stat info;
+                is_dir = fstatat(dir_fd, name, &info, 0) == 0 && S_ISDIR(info.st_mode);
+            }
+            turtle_complete_add(found, name, strlen(name), is_dir);
+        }
+    }
+    free(buffer);
+    close(dir_fd);
+}
+
+// every name on $PATH or among the builtins that starts with word
+void turtle_complete_commands(const char* word, struct Completion* found) {
+    turtle_commands_refresh();
+    found->typed = strlen(word);
+
+    // walk down to the node for the last letter of word, then everything under it matches
+    struct Trie_Node* node = turtle_editor.commands.root;
+    for (const char* c = word; *c != '\0' && node != NULL; c++) {
+        node = node->child;
+        while (node != NULL && node->letter != *c) {
+            node = node->sibling;
+        }
+    }
+    if (node == NULL) {
+        return;
+    }
+    char name[NAME_MAX + 1];
+    size_t length = found->typed < NAME_MAX ? found->typed : NAME_MAX;
+    memcpy(name, word, length);
+    turtle_commands_walk(node, name, length, found);
+}
+
+void turtle_commands_walk(struct Trie_Node* node, char* name, size_t length, struct Completion* found) {
+    if (node->end) {
+        turtle_complete_add(found, name, length, 0);
+    }
+    if (length == NAME_MAX) {
+        return;
+    }
+    for (struct Trie_Node* child = node->child; child != NULL; child = child->sibling) {
+        name[length] = child->letter;
+        turtle_commands_walk(child, name, length + 1, found);
+    }
+}
+
+// words the parser takes before a command, completed along with the builtins
+const char* turtle_prefix_names[] = {"time", "meter", "pipesize", NULL};
+
+// rebuild the command trie if PATH is not what it was built from or one of its directories has changed since;
+// checking costs one stat per directory, and each directory's time is taken before it is read so nothing slips by
+void turtle_commands_refresh() {
+    struct Command_Trie* trie = &turtle_editor.commands;
+    const char* path = getenv("PATH") != NULL ? getenv("PATH") : "";
+    char dir[MAX_PATH_LENGTH];
+    struct stat info;
+
+    int stale = trie->root == NULL || strcmp(path, trie->path) != 0;
+    const char* cur = path;
+    for (int i = 0; !stale && i < trie->dirs; i++) {
+        size_t length = strcspn(cur, ":");
+        snprintf(dir, sizeof(dir), "%.*s", (int) length, cur);
+        cur += length + (cur[length] == ':');
+        if (length > 0 && stat(dir, &info) == 0) {
+            stale = info.st_mtim.tv_sec != trie->mtimes[i].tv_sec || info.st_mtim.tv_nsec != trie->mtimes[i].tv_nsec;
+        } else {
+            stale = trie->mtimes[i].tv_sec != 0 || trie->mtimes[i].tv_nsec != 0;
+        }
+    }
+    if (!stale) {
+        return;
+    }
+
+    turtle_arena_release(&trie->arena);
+    trie->root = turtle_arena_alloc(&trie->arena, sizeof(struct Trie_Node));
+    trie->names = 0;
+    free(trie->path);
+    trie->path = strdup(path);
+    trie->dirs = 1;
+    for (const char* c = path; *c != '\0'; c++) {
+        trie->dirs += *c == ':';
+    }
+    trie->mtimes = realloc(trie->mtimes, trie->dirs * sizeof(struct timespec));
+
+    cur = path;
+    for (int i = 0; i < trie->dirs; i++) {
+        size_t length = strcspn(cur, ":");
+        snprintf(dir, sizeof(dir), "%.*s", (int) length, cur);
+        cur += length + (cur[length] == ':');
+        memset(&trie->mtimes[i], 0, sizeof(struct timespec));
+
+        // an empty entry means the current directory, which changes too often to be worth indexing
+        DIR* listing = length > 0 && stat(dir, &info) == 0 ? opendir(dir) : NULL;
+        if (listing == NULL) {
+            continue;
+        }
+        trie->mtimes[i] = info.st_mtim;
+        struct dirent* entry;
+        while ((entry = readdir(listing)) != NULL) {
+            if (entry->d_name[0] == '.' || entry->d_type == DT_DIR) {
+                continue;
+            }
+            if (faccessat(dirfd(listing), entry->d_name, X_OK, 0) == 0) {
+                turtle_commands_insert(entry->d_name);
+            }
+        }
+        closedir(listing);
+    }
+    for (int i = 0; turtle_builtins[i].name != NULL; i++) {
+        turtle_commands_insert(turtle_builtins[i].name);
+    }
+    for (int i = 0; turtle_prefix_names[i] != NULL; i++) {
+        turtle_commands_insert(turtle_prefix_names[i]);
+    }
+}
+
+// add a name, keeping each list of siblings in order so names come out of a walk sorted
+void turtle_commands_insert(const char* name) {
+    struct Command_Trie* trie = &turtle_editor.commands;
+    struct Trie_Node* node = trie->root;
+    for (const char* c = name; *c != '\0'; c++) {
+        struct Trie_Node** link = &node->child;
+        while (*link != NULL && (unsigned char) (*link)->letter < (unsigned char) *c) {
+            link = &(*link)->sibling;
+        }
+        if (*link == NULL || (*link)->letter != *c) {
+            struct Trie_Node* added = turtle_arena_alloc(&trie->arena, sizeof(struct Trie_Node));
+            added->letter = *c;
+            added->sibling = *link;
+            *link = added;
+        }
+        node = *link;
+    }
+    if (!node->end) {
+        node->end = 1;
+        trie->names++;
+    }
+}
+
+// feed a command string through the reader as if it had been read from a file
+void turtle_read_string(char* command) {
+    size_t length = strlen(command);
+
+    free(turtle_input.block);
+    turtle_input.block = malloc(length + 1);
+    if (!turtle_input.block) {
+        fprintf(stderr, "turtle failed to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(turtle_input.block, command, length);
+    turtle_input.block[length] = '\n';
+    turtle_input.block_start = 0;
+    turtle_input.block_end = length + 1;
+
+    // there is nothing more to read once the string is used up
+    turtle_input.fd = -1;
+}
+
+// bytes the lexer has to stop at, everything else is part of a plain word
+const unsigned char turtle_special_chars[256] = {
+    ['\0'] = 1, [' '] = 1, ['\t'] = 1, ['\r'] = 1, ['\n'] = 1, ['\a'] = 1,
+    ['|'] = 1, ['<'] = 1, ['>'] = 1, ['&'] = 1,
+    ['\''] = 1, ['"'] = 1, ['\\'] = 1, ['*'] = 1, ['?'] = 1,
+};
+
+// check eight bytes at once for anything the lexer has to stop at
+// each test sets the high bit of a byte that matches, so the result is nonzero on any match
+uint64_t turtle_swar_special(uint64_t chunk) {
+    // blanks, control characters, and the terminating nul are all below '!'
+    uint64_t found = (chunk - SWAR_ONES * '!') & ~chunk & SWAR_HIGHS;
+    uint64_t x;
+
+    x = chunk ^ (SWAR_ONES * '|');  found |= (x - SWAR_ONES) & ~x & SWAR_HIGHS;
+    x = chunk ^ (SWAR_ONES * '<');  found |= (x - SWAR_ONES) & ~x & SWAR_HIGHS;
+    x = chunk ^ (SWAR_ONES * '>');  found |= (x - SWAR_ONES) & ~x & SWAR_HIGHS;
+    x = chunk ^ (SWAR_ONES * '&');  found |= (x - SWAR_ONES) & ~x & SWAR_HIGHS;
+    x = chunk ^ (SWAR_ONES * '\''); found |= (x - SWAR_ONES) & ~x & SWAR_HIGHS;
+    x = chunk ^ (SWAR_ONES * '"');  found |= (x - SWAR_ONES) & ~x & SWAR_HIGHS;
+    x = chunk ^ (SWAR_ONES * '\\'); found |= (x - SWAR_ONES) & ~x & SWAR_HIGHS;
+    x = chunk ^ (SWAR_ONES * '*');  found |= (x - SWAR_ONES) & ~x & SWAR_HIGHS;
+    x = chunk ^ (SWAR_ONES * '?');  found |= (x - SWAR_ONES) & ~x & SWAR_HIGHS;
+
+    return found;
+}
+
+// add an empty token to the end of the list, making room if needed
+struct Token* turtle_add_token(struct Job* job, struct Token** tokens, int* count, int* capacity) {
+    if (*count == *capacity) {
+        *tokens = turtle_arena_grow(&job->arena, *tokens, *capacity * sizeof(struct Token),
+                                    *capacity * 2 * sizeof(struct Token));
+        *capacity *= 2;
+    }
+    return &(*tokens)[(*count)++];
+}
+
+// split a line into words and operators in a single pass
+// words are unquoted and unescaped in place, so no text is copied, and the line
+// must be followed by LEX_PADDING zero bytes since plain runs are scanned eight bytes at a time
+int turtle_lex(struct Job* job, char* line, struct Token** tokens) {
+    int count = 0, capacity = TOKEN_SIZE;
+    *tokens = turtle_arena_alloc(&job->arena, capacity * sizeof(struct Token));
+
+    char* r = line;
+    char c = *r;
+    while (1) {
+        // skip the blanks between tokens
+        while (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\a') {
+            c = *++r;
+        }
+        if (c == '\0') {
+            break;
+        }
+
+        struct Token* token = turtle_add_token(job, tokens, &count, &capacity);
+
+        // single character operators
+        if (c == '|' || c == '<' || c == '>' || c == '&') {
+            if (c == '|') {
+                token->type = PIPE;
+            } else if (c == '<') {
+                token->type = REDIRECT_IN;
+            } else if (c == '>') {
+                token->type = REDIRECT_OUT;
+            } else {
+                token->type = AMPERSAND;
+            }
+            c = *++r;
+            continue;
+        }
+
+        // anything else starts a word, written back over itself as quotes and escapes are removed
+        char* w = r;
+        token->type = WORD;
+        token->text = w;
+        if (c == '$' || (c == '"' && r[1] == '$')) {
+            token->flags |= TOKEN_VARIABLE;
+        }
+
+        while (1) {
+            // plain runs are copied eight bytes at a time
+            uint64_t chunk;
+            memcpy(&chunk, r, sizeof(chunk));
+            while (!turtle_swar_special(chunk)) {
+                if (w != r) {
+                    memmove(w, r, sizeof(chunk));
+                }
+                w += sizeof(chunk);
+                r += sizeof(chunk);
+                memcpy(&chunk, r, sizeof(chunk));
+            }
+
+            c = *r;
+            if (!turtle_special_chars[(unsigned char) c]) {
+                *w++ = *r++;
+            } else if (c == '*' || c == '?') {
+                token->flags |= TOKEN_GLOB;
+                *w++ = *r++;
+            } else if (c == '\\') {
+                // an escaped character is always taken literally
+                token->flags |= TOKEN_QUOTED;
+                r++;
+                if (*r != '\0') {
+                    *w++ = *r++;
+                    turtle_lex_quoted(job, token, w - 1, w, r);
+                }
+            } else if (c == '\'') {
+                // everything up to the closing single quote is literal
+                token->flags |= TOKEN_QUOTED;
+                char* close = strchr(r + 1, '\'');
+                if (close == NULL) {
+                    fprintf(stderr, "turtle: unterminated quote\n");
+                    return -1;
+                }
+                char* from = w;
+                memmove(w, r + 1, close - r - 1);
+                w += close - r - 1;
+                r = close + 1;
+                turtle_lex_quoted(job, token, from, w, r);
+            } else if (c == '"') {
+                // inside double quotes only \" \\ and \$ are escapes
+                token->flags |= TOKEN_QUOTED;
+                r++;
+                char* from = w;
+                while (*r != '"') {
+                    if (*r == '\0') {
+                        fprintf(stderr, "turtle: unterminated quote\n");
+                        return -1;
+                    }
+                    if (*r == '\\' && (r[1] == '"' || r[1] == '\\' || r[1] == '$')) {
+                        r++;
+                    }
+                    *w++ = *r++;
+                }
+                r++;
+                turtle_lex_quoted(job, token, from, w, r);
+            } else {
+                // blanks and operators end the word, so remember which before terminating it
+                break;
+            }
+        }
+        c = *r;
+        *w = '\0';
+    }
+
+    return count;
+}
+
+// mark the wildcard characters written between from and to as quoted, so they only match themselves
+// the mask is made the first time one turns up, big enough for the rest of the line after r
+void turtle_lex_quoted(struct Job* job, struct Token* token, char* from, char* to, char* r) {
+    for (char* cur = from; cur < to; cur++) {
+        if (*cur != '*' && *cur != '?' && *cur != '[' && *cur != '\\') {
+            continue;
+        }
+        if (token->quoted == NULL) {
+            token->quoted = turtle_arena_alloc(&job->arena, (to - token->text) + strlen(r) + 1);
+        }
+        token->quoted[cur - token->text] = 1;
+    }
+}
+
+struct Job* turtle_parse(char* input) {
+    // everything the job needs lives in its arena, including its own copy of the line
+    // since the input buffer is reused for the next line
+    struct Job* new_job = turtle_new_job();
+    size_t length = strlen(input);
+    char* line = turtle_arena_alloc(&new_job->arena, length + 1 + LEX_PADDING);
+    memcpy(line, input, length);
+    new_job->line = line;
+
+    struct Token* tokens;
+    int count = turtle_lex(new_job, line, &tokens);
+    if (count < 0) {
+        turtle_free_job(new_job);
+        return NULL;
+    }
+
+    // time, meter and pipesize run the rest of the line as usual, but change how it is
+    // connected or reported on; they can be given in any order
+    int prefixed = 0;
+    while (count > 0 && tokens[0].type == WORD && !(tokens[0].flags & TOKEN_QUOTED)) {
+        if (strcmp(tokens[0].text, "time") == 0) {
+            new_job->timed = 1;
+        } else if (strcmp(tokens[0].text, "meter") == 0) {
+            new_job->metered = 1;
+        } else if (strcmp(tokens[0].text, "pipesize") == 0) {
+            if (count < 2 || tokens[1].type != WORD || (new_job->pipe_size = turtle_parse_pipe_size(tokens[1].text)) < 0) {
+                fprintf(stderr, "turtle: pipesize takes a number of bytes, with k or m after it, or max\n");
+                turtle_free_job(new_job);
+                return NULL;
+            }
+            tokens++;
+            count--;
+        } else {
+            break;
+        }
+        tokens++;
+        count--;
+        prefixed = 1;
+    }
+    if (prefixed && count == 0) {
+        fprintf(stderr, "turtle: usage: [time] [meter] [pipesize bytes|max] command [| command...]\n");
+        turtle_free_job(new_job);
+        return NULL;
+    }
+
+    enum mode mode_type = FOREGROUND;
+    if (count > 0 && tokens[count - 1].type == AMPERSAND) {
+        mode_type = BACKGROUND;
+        count--;
+    }
+
+    // every pipe ends one command and starts the next
+    struct Command *root_cmd = NULL;
+    struct Command *cmd = NULL;
+    int start = 0;
+    for (int i = 0; i <= count; i++) {
+        if (i < count && tokens[i].type == AMPERSAND) {
+            fprintf(stderr, "turtle: syntax error near &\n");
+            turtle_free_job(new_job);
+            return NULL;
+        }
+        if (i < count && tokens[i].type != PIPE) {
+            continue;
+        }
+
+        struct Command* new_cmd = NULL;
+        if (i > start) {
+            new_cmd = turtle_parse_single(new_job, tokens + start, i - start);
+        } else {
+            fprintf(stderr, "turtle: syntax error near |\n");
+        }
+        if (new_cmd == NULL) {
+            turtle_free_job(new_job);
+            return NULL;
+        }
+
+        if (!root_cmd) {
+            root_cmd = new_cmd;
+            cmd = root_cmd;
+        } else {
+            cmd->next = new_cmd;
+            cmd = new_cmd;
+        }
+        start = i + 1;
+    }
+
+    new_job->root = root_cmd;
+    new_job->pgid = -1;
+    new_job->mode_type = mode_type;
+    return new_job;
+}
+
+struct Command* turtle_parse_single(struct Job* job, struct Token* tokens, int count) {
+    struct Arena* arena = &job->arena;
+    struct Arg_List list = {arena, NULL, 0, BUFFER_SIZE};
+    list.args = turtle_arena_alloc(arena, list.size * sizeof(char*));
+    char* input_path = NULL;
+    char* output_path = NULL;
+
+    // a batch command keeps its wildcards so they can be expanded a batch at a time
+    int batch = count > 0 && tokens[0].type == WORD && !(tokens[0].flags & TOKEN_QUOTED)
+                && strcmp(tokens[0].text, "batch") == 0;
+    if (batch) {
+        list.deferred = turtle_arena_alloc(arena, list.size);
+    } else if (shell != NULL && shell->autobatch) {
+        list.limit = turtle_arg_limit();
+    }
+
+    if (turtle_parse_args(tokens, count, &list, &input_path, &output_path) < 0) {
+        return NULL;
+    }
+
+    // with autobatch, an expansion too big for exec is started over as a batch command;
+    // builtins never exec, so they get every match instead of the part read before the walk stopped
+    if (list.limit > 0 && list.bytes > list.limit) {
+        batch = turtle_get_cmd_type(list.args[0]) == EXTERNAL;
+        list.count = 0;
+        list.bytes = 0;
+        list.limit = 0;
+        if (batch) {
+            list.deferred = turtle_arena_alloc(arena, list.size);
+        }
+        turtle_parse_args(tokens, count, &list, &input_path, &output_path);
+    }
+
+    if (list.count == 0) {
+        fprintf(stderr, "turtle: missing command\n");
+        return NULL;
+    }
+    list.args[list.count] = NULL;
+
+    struct Command* new_cmd = turtle_arena_alloc(arena, sizeof(struct Command));
+    new_cmd->argv = list.args;
+    new_cmd->argc = list.count;
+    new_cmd->input_path = input_path;
+    new_cmd->output_path = output_path;
+    new_cmd->pid = -1;
+    new_cmd->job = job;
+    new_cmd->cmd_type = batch ? BATCH : turtle_get_cmd_type(list.args[0]);
+    if (turtle_is_mover(new_cmd->cmd_type) && !turtle_mover_plain(new_cmd->cmd_type, list.args)) {
+        new_cmd->cmd_type = EXTERNAL;
+    }
+    new_cmd->deferred = list.deferred;
+    new_cmd->next = NULL;
+    return new_cmd;
+}
+
+// turn the tokens of one command into its arguments and redirections
+int turtle_parse_args(struct Token* tokens, int count, struct Arg_List* list, char** input_path, char** output_path) {
+    for (int t = 0; t < count; t++) {
+        struct Token* token = &tokens[t];
+
+        // io redirection takes the word that follows it
+        if (token->type == REDIRECT_IN || token->type == REDIRECT_OUT) {
+            if (t + 1 >= count || tokens[t + 1].type != WORD) {
+                fprintf(stderr, "turtle: syntax error near %c\n", token->type == REDIRECT_IN ? '<' : '>');
+                return -1;
+            }
+            if (token->type == REDIRECT_IN) {
+                *input_path = tokens[t + 1].text;
+            } else {
+                *output_path = tokens[t + 1].text;
+            }
+            t++;
+            continue;
+        }
+
+        char* arg = token->text;
+        // $? is the status of the last command, which is how test and [ are put to use
+        if ((token->flags & TOKEN_VARIABLE) && strcmp(arg, "$?") == 0) {
+            char status[16];
+            snprintf(status, sizeof(status), "%d", shell != NULL ? shell->last_status : 0);
+            turtle_add_arg(list, turtle_arena_strdup(list->arena, status));
+            continue;
+        }
+        if (token->flags & TOKEN_GLOB) {
+            char* pattern = turtle_glob_pattern(list->arena, token);
+            if (list->deferred != NULL) {
+                turtle_add_arg(list, pattern);
+                list->deferred[list->count - 1] = 1;
+                continue;
+            }
+
+            // a pattern that matches nothing is kept as it was typed
+            if (turtle_glob_each(pattern, turtle_add_glob_match, list) > 0) {
+                continue;
+            }
+        }
+
+        if (token->flags & TOKEN_VARIABLE) {
+            char* value = getenv(&(arg[1]));
+            turtle_add_arg(list, value != NULL ? value : turtle_arena_strdup(list->arena, "\n"));
+        } else {
+            turtle_add_arg(list, arg);
+        }
+    }
+    return 0;
+}
+
+// append an argument, growing the list geometrically
+void turtle_add_arg(struct Arg_List* list, char* arg) {
+    // leave room for the terminating NULL
+    if (list->count + 1 >= list->size) {
+        int old_size = list->size;
+        list->size *= 2;
+        list->args = turtle_arena_grow(list->arena, list->args, old_size * sizeof(char*),
+                                       list->size * sizeof(char*));
+        if (list->deferred != NULL) {
+            list->deferred = turtle_arena_grow(list->arena, list->deferred, old_size, list->size);
+        }
+    }
+    if (list->limit > 0) {
+        list->bytes += strlen(arg) + 1 + sizeof(char*);
+    }
+    list->args[list->count++] = arg;
+}
+
+// take a copy of each path a glob matches, since the walk reuses its buffer
+// stops the walk once the arguments have grown past the list's limit
+int turtle_add_glob_match(const char* path, void* data) {
+    struct Arg_List* list = data;
+    turtle_add_arg(list, turtle_arena_strdup(list->arena, path));
+    return list->limit > 0 && list->bytes > list->limit;
+}
+
+// bytes of arguments exec will take, after the environment and some headroom
+long turtle_arg_limit() {
+    long limit = sysconf(_SC_ARG_MAX);
+    for (char** env = environ; *env != NULL; env++) {
+        limit -= strlen(*env) + 1 + sizeof(char*);
+    }
+    return limit - ARG_HEADROOM;
+}
+
+// bytes these arguments take in exec
+long turtle_arg_bytes(char** argv) {
+    long bytes = 0;
+    for (char** arg = argv; *arg != NULL; arg++) {
+        bytes += strlen(*arg) + 1 + sizeof(char*);
+    }
+    return bytes;
+}
+
+enum command_type turtle_get_cmd_type(char* cmd_name) {
+    for (int i = 0; turtle_builtins[i].name != NULL; i++) {
+        if (strcmp(cmd_name, turtle_builtins[i].name) == 0) {
+            return turtle_builtins[i].type;
+        }
+    }
+    return EXTERNAL;
+}
+
+int turtle_execute(struct Job* job) {
+    int exec_ret = 1, job_id = -1;
+
+    // anything that may start a process goes in the table so its children can be found
+    if (job->root->cmd_type == EXTERNAL || turtle_is_mover(job->root->cmd_type) || job->root->next != NULL) {
+        job_id = turtle_insert_job(job);
+    }
+
+    // the scheduler may hold background jobs back until a slot frees up
+    if (job_id >= 0 && job->mode_type == BACKGROUND && shell->sched_enabled) {
+        if (turtle_sched_admit(job) < 0) {
+            if (shell->interactive) {
+                printf("[%d] queued\n", job_id);
+            }
+            return 0;
+        }
+    }
+
+    // a builtin in the job, such as jobs | grep, should not see the job it is part of
+    struct Job* outer_job = shell->current_job;
+    shell->current_job = job;
+    int run_ret = turtle_run_job(job, &exec_ret);
+    shell->current_job = outer_job;
+
+    if (run_ret < 0) {
+        if (job_id < 0) {
+            turtle_free_job(job);
+        } else {
+            turtle_remove_job(job_id);
+        }
+        shell->last_status = 1;
+        return -1;
+    }
+
+    // a job left running in the background counts as a success, as in sh
+    shell->last_status = 0;
+    if (job->mode_type == FOREGROUND) {
+        struct Command* last = job->root;
+        while (last->next != NULL) {
+            last = last->next;
+        }
+        shell->last_status = last->exit_code;
+    }
+
+    if (job->timed && job->mode_type == FOREGROUND && exec_ret >= 0) {
+        turtle_print_usage(stderr, job);
+    }
+    if (job->meters != NULL && job->mode_type == FOREGROUND && exec_ret >= 0) {
+        turtle_meter_finish(job);
+        turtle_print_meters(stderr, job);
+    }
+
+    if (job_id >= 0) {
+        if ((exec_ret >= 0 && job->mode_type == FOREGROUND) || turtle_job_finished(job)) {
+            turtle_remove_job(job_id);
+        } else if (job->mode_type == BACKGROUND && shell->interactive) {
+            turtle_print_process(job_id);
+        }
+    } else {
+        // nothing keeps track of jobs outside the table, so release them now
+        turtle_free_job(job);
+    }
+
+    return exec_ret;
+}
+
+// start every command of the job, connecting them with pipes
+// returns -1 if the job could not be started at all
+int turtle_run_job(struct Job* job, int* exec_ret) {
+    int in_fd = 0, fd[2], link = 0;
+
+    struct Command* cur_cmd = job->root;
+    while (cur_cmd != NULL) {
+        if (cur_cmd == job->root && cur_cmd->input_path != NULL) {
+            in_fd = open(cur_cmd->input_path, O_RDONLY | O_CLOEXEC);
+            if (in_fd < 0) {
+                printf("turtle found no such file or directory to read from: %s\n", cur_cmd->input_path);
+                return -1;
+            }
+        }
+        // identified piping
+        if (cur_cmd->next != NULL) {
+            if (turtle_make_link(job, ++link, fd) < 0) {
+                fprintf(stderr, "turtle: could not create a pipe: %s\n", strerror(errno));
+                turtle_close_fds(in_fd, 1);
+                return -1;
+            }
+            *exec_ret = turtle_execute_single(job, cur_cmd, in_fd, fd[1], PIPELINE);
+            in_fd = fd[0];
+        } else {
+            int out_fd = 1;
+            if (cur_cmd->output_path != NULL) {
+                out_fd = open(cur_cmd->output_path, O_CREAT|O_WRONLY|O_TRUNC|O_CLOEXEC, 0x600);
+                if (out_fd < 0) {
+                    out_fd = 1;
+                }
+            }
+            *exec_ret = turtle_execute_single(job, cur_cmd, in_fd, out_fd, job->mode_type);
+        }
+
+        cur_cmd = cur_cmd->next;
+    }
+
+    return 0;
+}
+
+// read a capacity for pipesize: bytes, with k or m after them, or max for the most the system allows
+// returns -1 if it makes no sense
+int turtle_parse_pipe_size(const char* text) {
+    if (strcmp(text, "max") == 0) {
+        return shell->pipe_max;
+    }
+
+    char* end;
+    long size = strtol(text, &end, 10);
+    if (*end == 'k' || *end == 'K') {
+        size <<= 10;
+        end++;
+    } else if (*end == 'm' || *end == 'M') {
+        size <<= 20;
+        end++;
+    }
+    if (end == text || *end != '\0' || size <= 0) {
+        return -1;
+    }
+
+    if (size > shell->pipe_max) {
+        size = shell->pipe_max;
+    } else if (size < PIPE_MIN_SIZE) {
+        size = PIPE_MIN_SIZE;
+    }
+    return size;
+}
+
+// create the pipe between two stages of a job, sized as the job asked
+// a metered job gets two pipes with a relay thread between them that does the counting
+int turtle_make_link(struct Job* job, int link, int fd[2]) {
+    if (pipe2(fd, O_CLOEXEC) < 0) {
+        return -1;
+    }
+    if (job->pipe_size > 0) {
+        fcntl(fd[1], F_SETPIPE_SZ, job->pipe_size);
+    }
+    if (!job->metered) {
+        return 0;
+    }
+
+    int relay[2];
+    if (pipe2(relay, O_CLOEXEC) < 0) {
+        // an unmetered pipe still runs the job
+        return 0;
+    }
+
+    struct Pipe_Meter* meter = turtle_arena_alloc(&job->arena, sizeof(struct Pipe_Meter));
+    meter->link = link;
+    meter->in_fd = fd[0];
+    meter->out_fd = relay[1];
+    meter->capacity = fcntl(fd[0], F_GETPIPE_SZ);
+    meter->floor = meter->capacity;
+    fcntl(relay[1], F_SETPIPE_SZ, meter->capacity);
+    clock_gettime(CLOCK_MONOTONIC, &meter->start);
+
+    // the relay must never take a signal meant for the shell, and a reader that goes away
+    // should show up as EPIPE rather than a SIGPIPE that would end the whole shell
+    sigset_t all_signals, saved_signals;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_SETMASK, &all_signals, &saved_signals);
+    int created = pthread_create(&meter->thread, NULL, turtle_meter_relay, meter);
+    pthread_sigmask(SIG_SETMASK, &saved_signals, NULL);
+    if (created != 0) {
+        close(relay[0]);
+        close(relay[1]);
+        return 0;
+    }
+
+    fd[0] = relay[0];
+    struct Pipe_Meter** tail = &job->meters;
+    while (*tail != NULL) {
+        tail = &(*tail)->next;
+    }
+    *tail = meter;
+    return 0;
+}
+
+static void turtle_meter_resize(struct Pipe_Meter* meter, int capacity) {
+    int resized = fcntl(meter->in_fd, F_SETPIPE_SZ, capacity);
+    if (resized > 0) {
+        fcntl(meter->out_fd, F_SETPIPE_SZ, resized);
+        meter->capacity = resized;
+        meter->resizes++;
+    }
+}
+
+// move everything from one pipe of a metered link into the next, counting it on the way
+void* turtle_meter_relay(void* arg) {
+    struct Pipe_Meter* meter = arg;
+    int full_streak = 0, empty_streak = 0;
+
+    while (1) {
+        // how far the writer has got ahead when the relay comes back for more is how full the pipe runs
+        struct pollfd input_poll = {meter->in_fd, POLLIN, 0};
+        int waiting = 0;
+        if (poll(&input_poll, 1, -1) < 0 && errno != EINTR) {
+            break;
+        }
+        ioctl(meter->in_fd, FIONREAD, &waiting);
+        if (waiting > meter->peak_fill) {
+            meter->peak_fill = waiting;
+        }
+
+        // 0 means every writer is done, EPIPE that the reader went away
+        ssize_t moved = splice(meter->in_fd, NULL, meter->out_fd, NULL, meter->capacity, SPLICE_F_MOVE);
+        if (moved <= 0) {
+            break;
+        }
+        __atomic_add_fetch(&meter->bytes, moved, __ATOMIC_RELAXED);
+
+        // a pipe found nearly full time after time is making its writer wait, and one that
+        // is nearly empty for a long while is holding on to memory it does not use
+        full_streak = waiting >= meter->capacity / 4 * 3 ? full_streak + 1 : 0;
+        empty_streak = waiting < meter->capacity / 8 ? empty_streak + 1 : 0;
+        if (full_streak >= METER_GROW_AFTER && meter->capacity < shell->pipe_max) {
+            turtle_meter_resize(meter, meter->capacity * 2 < shell->pipe_max ? meter->capacity * 2 : shell->pipe_max);
+            full_streak = 0;
+        } else if (empty_streak >= METER_SHRINK_AFTER && meter->capacity > meter->floor) {
+            turtle_meter_resize(meter, meter->capacity / 2 > meter->floor ? meter->capacity / 2 : meter->floor);
+            empty_streak = 0;
+        }
+    }
+
+    // closing both ends passes the end of the data, or the missing reader, on to the other side
+    close(meter->in_fd);
+    close(meter->out_fd);
+    clock_gettime(CLOCK_MONOTONIC, &meter->end);
+    __atomic_store_n(&meter->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// wait for the relays of a job to pass on the last of their data
+void turtle_meter_finish(struct Job* job) {
+    for (struct Pipe_Meter* meter = job->meters; meter != NULL; meter = meter->next) {
+        if (!meter->joined) {
+            pthread_join(meter->thread, NULL);
+            meter->joined = 1;
+        }
+    }
+}
+
+// one line per pipe with how much went through it, how fast, and how big the pipe got
+void turtle_print_meters(FILE* out, struct Job* job) {
+    for (struct Pipe_Meter* meter = job->meters; meter != NULL; meter = meter->next) {
+        int done = __atomic_load_n(&meter->done, __ATOMIC_ACQUIRE);
+        long bytes = __atomic_load_n(&meter->bytes, __ATOMIC_RELAXED);
+        struct timespec now;
+        if (done) {
+            now = meter->end;
+        } else {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+        }
+        double seconds = turtle_seconds(&meter->start, &now);
+        double rate = seconds > 0 ? bytes / seconds : 0;
+
+        fprintf(out, "\tpipe %d\t%.1f MB\t%.1f MB/s\tcapacity %d KiB, peak %d%%, resized %d times\t%s\n",
+                meter->link, bytes / 1048576.0, rate / 1048576.0, meter->capacity / 1024,
+                meter->capacity > 0 ? (int) (100L * meter->peak_fill / meter->capacity) : 0, meter->resizes,
+                done ? "done" : "running");
+    }
+}
+
+// take a slot for a background job, or put it at the back of the queue if none are free
+// returns -1 if the job was queued
+int turtle_sched_admit(struct Job* job) {
+    if (shell->sched_max > 0 && shell->sched_running >= shell->sched_max) {
+        struct Command* cur_cmd = job->root;
+        while (cur_cmd != NULL) {
+            cur_cmd->status_type = QUEUED;
+            cur_cmd = cur_cmd->next;
+        }
+
+        job->queued = 1;
+        job->queue_next = NULL;
+        if (shell->sched_tail != NULL) {
+            shell->sched_tail->queue_next = job;
+        } else {
+            shell->sched_head = job;
+        }
+        shell->sched_tail = job;
+        shell->sched_queued++;
+        return -1;
+    }
+
+    job->scheduled = 1;
+    shell->sched_running++;
+    return 0;
+}
+
+// take a job out of the queue without starting it
+void turtle_sched_unqueue(struct Job* job) {
+    struct Job* previous = NULL;
+    struct Job* cur_job = shell->sched_head;
+    while (cur_job != NULL && cur_job != job) {
+        previous = cur_job;
+        cur_job = cur_job->queue_next;
+    }
+    if (cur_job == NULL) {
+        return;
+    }
+
+    if (previous != NULL) {
+        previous->queue_next = job->queue_next;
+    } else {
+        shell->sched_head = job->queue_next;
+    }
+    if (shell->sched_tail == job) {
+        shell->sched_tail = previous;
+    }
+    job->queued = 0;
+    shell->sched_queued--;
+}
+
+// start queued jobs, oldest first, while there are free slots
+void turtle_sched_dispatch() {
+    // starting a job can finish one, which would call back in here
+    if (shell->sched_dispatching) {
+        return;
+    }
+    shell->sched_dispatching = 1;
+
+    while (shell->sched_head != NULL
+           && (!shell->sched_enabled || shell->sched_max <= 0 || shell->sched_running < shell->sched_max)) {
+        struct Job* job = shell->sched_head;
+        turtle_sched_unqueue(job);
+
+        job->scheduled = 1;
+        shell->sched_running++;
+
+        // a job whose commands all ended without a process, like one that was not found,
+        // will never be reaped, so it gives its slot back here
+        int exec_ret = 0;
+        struct Job* outer_job = shell->current_job;
+        shell->current_job = job;
+        int run_ret = turtle_run_job(job, &exec_ret);
+        shell->current_job = outer_job;
+        if (run_ret < 0 || turtle_job_finished(job)) {
+            turtle_remove_job(job->id);
+        }
+    }
+
+    shell->sched_dispatching = 0;
+}
+
+// whether any scheduled job still has a process running that will show up on the signalfd
+int turtle_sched_live() {
+    for (int i = 1; i < shell->jobs_size; i++) {
+        struct Job* job = shell->jobs[i];
+        if (job == NULL || !job->scheduled) {
+            continue;
+        }
+        for (struct Command* cmd = job->root; cmd != NULL; cmd = cmd->next) {
+            if (cmd->pid > 0 && (cmd->status_type == RUNNING || cmd->status_type == CONTINUED)) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// let every queued job run to the end, used before a batch of commands exits
+void turtle_sched_drain() {
+    struct pollfd child_poll;
+    child_poll.fd = shell->child_fd;
+    child_poll.events = POLLIN;
+
+    while (shell->sched_head != NULL && shell->child_fd >= 0) {
+        // with nothing left to reap, waiting would never end, so start what is queued or give up
+        if (!turtle_sched_live()) {
+            turtle_sched_dispatch();
+            if (!turtle_sched_live()) {
+                return;
+            }
+            continue;
+        }
+        if (poll(&child_poll, 1, -1) < 0 && errno != EINTR) {
+            return;
+        }
+        turtle_check_children();
+    }
+}
+
+int turtle_insert_job(struct Job* job) {
+    // ids are handed out lowest first, starting from the lowest one that was freed
+    int id = shell->jobs_free;
+    while (id < shell->jobs_size && shell->jobs[id] != NULL) {
+        id++;
+    }
+
+    // out of slots, so double the table
+    if (id >= shell->jobs_size) {
+        int old_size = shell->jobs_size;
+        shell->jobs_size *= 2;
+        shell->jobs = realloc(shell->jobs, shell->jobs_size * sizeof(struct Job*));
+        if (!shell->jobs) {
+            fprintf(stderr, "turtle failed to allocate memory\n");
+            exit(EXIT_FAILURE);
+        }
+        memset(shell->jobs + old_size, 0, (shell->jobs_size - old_size) * sizeof(struct Job*));
+    }
+
+    job->id = id;
+    shell->jobs[id] = job;
+    shell->jobs_count++;
+    shell->jobs_free = id + 1;
+    return id;
+}
+
+// look up a job by id, or NULL if there is no such job
+struct Job* turtle_get_job(int id) {
+    if (id <= 0 || id >= shell->jobs_size) {
+        return NULL;
+    }
+    return shell->jobs[id];
+}
+
+int turtle_remove_job(int id) {
+    if (turtle_get_job(id) == NULL) {
+        return -1;
+    }
+    
+    // give back the job's place in the scheduler
+    struct Job* job = shell->jobs[id];
+    int free_slot = job->scheduled;
+    if (job->queued) {
+        turtle_sched_unqueue(job);
+    } else if (job->scheduled) {
+        shell->sched_running--;
+    }
+
+    // free all the memory associated with this job
+    turtle_free_job(job);
+
+    shell->jobs[id] = NULL;
+    shell->jobs_count--;
+    if (id < shell->jobs_free) {
+        shell->jobs_free = id;
+    }
+
+    if (free_slot) {
+        turtle_sched_dispatch();
+    }
+
+    return 0;
+}
+
+int turtle_remove_process(int pid) {
+    struct Command* cmd = turtle_find_pid(pid);
+
+    // couldn't find the process to change its status of
+    if (cmd == NULL) {
+        return -1;
+    }
+
+    // jobs outside the table are released by whoever is running them
+    if (turtle_get_job(cmd->job->id) != cmd->job) {
+        return -1;
+    }
+
+    turtle_remove_job(cmd->job->id);
+    return 0;
+}
+
+int turtle_print_process(int id) {
+    if (turtle_get_job(id) == NULL) {
+        return -1;
+    }
+
+    printf("[%d]", id);
+
+    struct Command* cur_cmd = shell->jobs[id]->root;
+    while (cur_cmd != NULL) {
+        printf(" %d", cur_cmd->pid);
+        cur_cmd = cur_cmd->next;
+    }
+    printf("\n");
+
+    return 0;
+}
+
+// run a builtin command inside the shell itself
+int turtle_execute_builtin(struct Command* cmd, int in_fd, int out_fd) {
+    if (cmd->cmd_type == EXIT) {
+        return turtle_exit(cmd->argc, cmd->argv);
+    } else if (cmd->cmd_type == CD) {
+        return turtle_cd(cmd->argc, cmd->argv);
+    } else if (cmd->cmd_type == JOBS) {
+        return turtle_jobs(cmd->argc, cmd->argv);
+    } else if (cmd->cmd_type == FG) {
+        return turtle_fg(cmd->argc, cmd->argv);
+    } else if (cmd->cmd_type == BG) {
+        return turtle_bg(cmd->argc, cmd->argv);
+    } else if (cmd->cmd_type == KILL) {
+        return turtle_kill(cmd->argc, cmd->argv);
+    } else if (cmd->cmd_type == UNSET) {
+        return turtle_unset(cmd->argc, cmd->argv);
+    } else if (cmd->cmd_type == HISTORY) {
+        return turtle_history(cmd->argc, cmd->argv);
+    } else if (cmd->cmd_type == THEME) {
+        return turtle_theme(cmd->argc, cmd->argv);
+    } else if (cmd->cmd_type == HELP) {
+        return turtle_help();
+    } else if (cmd->cmd_type == TURTLESAY) {
+        return turtlesay(cmd->argv);
+    } else if (cmd->cmd_type == HASH) {
+        return turtle_hash(cmd->argc, cmd->argv);
+    } else if (cmd->cmd_type == ENGINE) {
+        return turtle_engine_cmd(cmd->argc, cmd->argv);
+    } else if (cmd->cmd_type == ARENA) {
+        return turtle_arena();
+    } else if (cmd->cmd_type == SCHED) {
+        return turtle_sched(cmd->argc, cmd->argv);
+    } else if (cmd->cmd_type == PARALLEL) {
+        return turtle_parallel(cmd->argc, cmd->argv, in_fd, out_fd);
+    } else if (cmd->cmd_type == GLOBCACHE) {
+        return turtle_globcache(cmd->argc, cmd->argv);
+    } else if (cmd->cmd_type == BATCH) {
+        return turtle_batch(cmd, in_fd, out_fd);
+    } else if (cmd->cmd_type == AUTOBATCH) {
+        return turtle_autobatch(cmd->argc, cmd->argv);
+    } else if (cmd->cmd_type == TRACE) {
+        return turtle_trace_cmd(cmd->argc, cmd->argv);
+    } else if (cmd->cmd_type == PROMPT) {
+        return turtle_prompt_cmd(cmd->argc, cmd->argv);
+    }
+    return -1;
+}
+
+// the shell's copies of a stage's fds must be closed as soon as the stage owns them,
+// otherwise readers never see end of file and writers never see a broken pipe
+void turtle_close_fds(int in_fd, int out_fd) {
+    if (in_fd != 0) {
+        close(in_fd);
+    }
+    if (out_fd != 1) {
+        close(out_fd);
+    }
+}
+
+// is this one of the utilities run inside the shell in place of a program
+int turtle_is_utility(enum command_type cmd_type) {
+    return cmd_type >= ECHO_UTIL && cmd_type <= PWD_UTIL;
+}
+
+// run a utility, writing what it prints to out
+// returns its exit status
+int turtle_run_utility(struct Command* cmd, FILE* out) {
+    if (cmd->cmd_type == ECHO_UTIL) {
+        return turtle_echo(cmd->argc, cmd->argv, out);
+    } else if (cmd->cmd_type == PRINTF_UTIL) {
+        return turtle_printf(cmd->argc, cmd->argv, out);
+    } else if (cmd->cmd_type == TEST_UTIL) {
+        return turtle_test(cmd->argc, cmd->argv);
+    } else if (cmd->cmd_type == TRUE_UTIL) {
+        return 0;
+    } else if (cmd->cmd_type == FALSE_UTIL) {
+        return 1;
+    } else if (cmd->cmd_type == PWD_UTIL) {
+        return turtle_pwd(out);
+    }
+    return 127;
+}
+
+// stdio hands the sink each piece of output as it is printed
+static ssize_t turtle_sink_write(void* cookie, const char* data, size_t length) {
+    struct Sink* sink = cookie;
+
+    if (sink->used + length > sink->size) {
+        if (sink->hold) {
+            while (sink->used + length > sink->size) {
+                sink->size *= 2;
+            }
+            sink->buffer = realloc(sink->buffer, sink->size);
+        } else if (length >= sink->size / 2) {
+            // too big to be worth copying, so it goes out right behind what is buffered
+            turtle_sink_flush(sink, data, length);
+            return length;
+        } else {
+            turtle_sink_flush(sink, NULL, 0);
+        }
+    }
+
+    memcpy(sink->buffer + sink->used, data, length);
+    sink->used += length;
+    return length;
+}
+
+// get a stream that gathers output for fd
+// with hold, nothing is written until turtle_sink_finish, however much is printed
+FILE* turtle_sink_open(struct Sink* sink, int fd, int hold) {
+    cookie_io_functions_t functions = {NULL, turtle_sink_write, NULL, NULL};
+
+    sink->fd = fd;
+    sink->hold = hold;
+    sink->used = 0;
+    sink->size = SINK_SIZE;
+    sink->buffer = malloc(sink->size);
+
+    // the sink does the buffering, so stdio passes every printf straight through
+    sink->file = fopencookie(sink, "w", functions);
+    setvbuf(sink->file, NULL, _IONBF, 0);
+    return sink->file;
+}
+
+// write out what is buffered, followed by extra, in a single writev where possible
+void turtle_sink_flush(struct Sink* sink, const char* extra, size_t extra_length) {
+    struct iovec iov[2] = {{sink->buffer, sink->used}, {(void*) extra, extra_length}};
+    struct iovec* cur = iov;
+    int count = extra_length > 0 ? 2 : 1;
+
+    // whatever the shell already printed to the terminal comes first
+    if (sink->fd == STDOUT_FILENO) {
+        fflush(stdout);
+    }
+
+    while (count > 0) {
+        ssize_t written = writev(sink->fd, cur, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        while (count > 0 && written >= (ssize_t) cur->iov_len) {
+            written -= cur->iov_len;
+            cur++;
+            count--;
+        }
+        if (count > 0) {
+            cur->iov_base = (char*) cur->iov_base + written;
+            cur->iov_len -= written;
+        }
+    }
+    sink->used = 0;
+}
+
+// send the rest of the output on its way and release the sink
+void turtle_sink_finish(struct Job* job, struct Command* cmd, struct Sink* sink) {
+    fclose(sink->file);
+
+    // the rest of the pipeline has not started yet, so a write bigger than the pipe
+    // would never finish; a child that does nothing but write takes the output instead
+    int capacity = sink->hold ? fcntl(sink->fd, F_GETPIPE_SZ) : 0;
+    if (capacity > 0 && sink->used > capacity) {
+        fflush(stdout);
+        pid_t child = fork();
+        if (child == 0) {
+            signal(SIGINT, SIG_DFL);
+            turtle_sink_flush(sink, NULL, 0);
+            _exit(cmd->exit_code);
+        } else if (child > 0) {
+            cmd->pid = child;
+            if (job->pgid <= 0) {
+                job->pgid = child;
+            }
+            setpgid(child, job->pgid);
+            turtle_index_pid(cmd);
+            free(sink->buffer);
+            return;
+        }
+    }
+
+    turtle_sink_flush(sink, NULL, 0);
+    free(sink->buffer);
+    cmd->status_type = DONE;
+}
+
+// is this one of the utilities that moves data from in_fd to out_fd
+int turtle_is_mover(enum command_type cmd_type) {
+    return cmd_type == CAT_MOVER || cmd_type == TEE_MOVER;
+}
+
+// the movers only know how to copy, so any option beyond tee's -a is left to the real program
+int turtle_mover_plain(enum command_type cmd_type, char** argv) {
+    for (int i = 1; argv[i] != NULL; i++) {
+        if (cmd_type == TEE_MOVER && i == 1 && strcmp(argv[i], "-a") == 0) {
+            continue;
+        }
+        if (argv[i][0] == '-' && (cmd_type == TEE_MOVER || argv[i][1] != '\0')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// run a mover, returning its exit status
+int turtle_run_mover(struct Command* cmd, int in_fd, int out_fd) {
+    if (cmd->cmd_type == CAT_MOVER) {
+        return turtle_cat(cmd->argc, cmd->argv, in_fd, out_fd);
+    } else if (cmd->cmd_type == TEE_MOVER) {
+        return turtle_tee(cmd->argc, cmd->argv, in_fd, out_fd);
+    }
+    return 127;
+}
+
+// write all of data to fd, however many writes it takes
+int turtle_write_all(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += written;
+        length -= written;
+    }
+    return 0;
+}
+
+static const char* turtle_move_names[] = {"copy_file_range", "splice", "sendfile", "read/write"};
+
+// pick the cheapest way the kernel offers to move data between these two kinds of fd
+enum move_method turtle_move_method(int in_fd, int out_fd) {
+    struct stat in_info, out_info;
+    if (fstat(in_fd, &in_info) < 0 || fstat(out_fd, &out_info) < 0) {
+        return MOVE_READ_WRITE;
+    }
+
+    if (S_ISFIFO(in_info.st_mode) || S_ISFIFO(out_info.st_mode)) {
+        return MOVE_SPLICE;
+    }
+    if (S_ISREG(in_info.st_mode) && S_ISREG(out_info.st_mode)) {
+        return MOVE_COPY_RANGE;
+    }
+    // sendfile needs an input it can map, but will write to anything
+    if (S_ISREG(in_info.st_mode) || S_ISBLK(in_info.st_mode)) {
+        return MOVE_SENDFILE;
+    }
+    return MOVE_READ_WRITE;
+}
+
+// move everything from in_fd to out_fd, keeping it inside the kernel whenever the fd types allow
+// returns the number of bytes moved, or -1 on an error or ctrl-c
+ssize_t turtle_move(int in_fd, int out_fd) {
+    enum move_method method = turtle_move_method(in_fd, out_fd);
+    uint64_t trace_start = turtle_trace_begin();
+    char* buffer = NULL;
+    ssize_t total = 0, moved;
+
+    while (1) {
+        if (method == MOVE_COPY_RANGE) {
+            moved = copy_file_range(in_fd, NULL, out_fd, NULL, MOVE_CHUNK, 0);
+        } else if (method == MOVE_SPLICE) {
+            moved = splice(in_fd, NULL, out_fd, NULL, MOVE_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+        } else if (method == MOVE_SENDFILE) {
+            moved = sendfile(out_fd, in_fd, NULL, MOVE_CHUNK);
+        } else {
+            if (buffer == NULL) {
+                buffer = malloc(MOVE_BUFFER);
+            }
+            moved = read(in_fd, buffer, MOVE_BUFFER);
+            if (moved > 0 && turtle_write_all(out_fd, buffer, moved) < 0) {
+                moved = -1;
+            }
+        }
+
+        if (moved > 0) {
+            total += moved;
+            continue;
+        } else if (moved == 0) {
+            break;
+        }
+
+        // the kernel will not pair these fds this way (a terminal, a file opened to append,
+        // two filesystems), and every method leaves the offsets where they were, so copy the rest
+        if (method != MOVE_READ_WRITE && (errno == EINVAL || errno == EXDEV || errno == EBADF || errno == ENOSYS || errno == EOPNOTSUPP)) {
+            method = MOVE_READ_WRITE;
+            continue;
+        }
+        total = -1;
+        break;
+    }
+
+    free(buffer);
+    turtle_trace_end("move", turtle_move_names[method], trace_start, total);
+    return total;
+}
+
+// take length bytes that are known to be waiting in the pipe src
+static int turtle_fan_take(int src, char* buffer, size_t length) {
+    while (length > 0) {
+        ssize_t got = read(src, buffer, length);
+        if (got <= 0) {
+            return -1;
+        }
+        buffer += got;
+        length -= got;
+    }
+    return 0;
+}
+
+// give fd a copy of the first length bytes waiting in the pipe src, leaving them in src
+// returns how many bytes fd got; any fewer than length have to be copied by hand
+static size_t turtle_fan_tee(int src, int fd, int is_pipe, int side[2], size_t length) {
+    if (is_pipe) {
+        ssize_t copied = tee(src, fd, length, 0);
+        return copied < 0 ? 0 : copied;
+    }
+
+    // tee only writes to pipes, so the copy goes into the empty side pipe and is spliced on from there
+    ssize_t copied = tee(src, side[1], length, 0);
+    if (copied <= 0) {
+        return 0;
+    }
+    size_t left = copied;
+    while (left > 0) {
+        ssize_t moved = splice(side[0], NULL, fd, NULL, left, SPLICE_F_MOVE);
+        if (moved <= 0) {
+            break;
+        }
+        left -= moved;
+    }
+
+    // fd will not take a splice, so empty the side pipe into it through a buffer
+    char chunk[4096];
+    while (left > 0) {
+        ssize_t got = read(side[0], chunk, left < sizeof(chunk) ? left : sizeof(chunk));
+        if (got <= 0) {
+            break;
+        }
+        turtle_write_all(fd, chunk, got);
+        left -= got;
+    }
+    return copied;
+}
+
+// copy everything from in_fd to every one of out_fds; all but the last get a duplicate of the
+// pipe buffers from tee(2) and the last has them spliced over, so nothing is copied through the shell
+// returns the number of bytes read, or -1 on an error or ctrl-c
+ssize_t turtle_fan_out(int in_fd, int* out_fds, int count) {
+    if (count == 1) {
+        return turtle_move(in_fd, out_fds[0]);
+    }
+
+    struct stat info;
+    int* is_pipe = malloc(count * sizeof(int));
+    size_t* sent = malloc(count * sizeof(size_t));
+    char* buffer = NULL;
+    for (int i = 0; i < count; i++) {
+        is_pipe[i] = fstat(out_fds[i], &info) == 0 && S_ISFIFO(info.st_mode);
+    }
+
+    // tee only duplicates what is already in a pipe, so any other input is spliced into one first
+    int src = in_fd, feed[2] = {-1, -1}, side[2], copying = 0;
+    if (fstat(in_fd, &info) < 0 || !S_ISFIFO(info.st_mode)) {
+        pipe2(feed, O_CLOEXEC);
+        src = feed[0];
+    }
+    // outputs that are not pipes take their copy through a side pipe big enough for a whole chunk
+    pipe2(side, O_CLOEXEC);
+    int capacity = fcntl(src, F_GETPIPE_SZ);
+    fcntl(side[1], F_SETPIPE_SZ, capacity);
+
+    uint64_t trace_start = turtle_trace_begin();
+    ssize_t total = 0, length;
+    while (1) {
+        if (copying) {
+            length = read(in_fd, buffer, MOVE_CHUNK);
+        } else if (feed[1] >= 0) {
+            length = splice(in_fd, NULL, feed[1], NULL, capacity, SPLICE_F_MOVE);
+            if (length < 0 && errno == EINVAL) {
+                // a terminal cannot be spliced from, so the rest is read and written as usual
+                buffer = buffer == NULL ? malloc(MOVE_CHUNK) : buffer;
+                copying = 1;
+                continue;
+            }
+        } else {
+            // wait for the writer, then take as much as it has put in the pipe so far
+            struct pollfd input_poll = {src, POLLIN, 0};
+            int waiting = 0;
+            if (poll(&input_poll, 1, -1) < 0 || ioctl(src, FIONREAD, &waiting) < 0) {
+                length = -1;
+            } else {
+                length = waiting < MOVE_CHUNK ? waiting : MOVE_CHUNK;
+            }
+        }
+        if (length <= 0) {
+            if (length < 0) {
+                total = -1;
+            }
+            break;
+        }
+        total += length;
+
+        if (copying) {
+            for (int i = 0; i < count; i++) {
+                turtle_write_all(out_fds[i], buffer, length);
+            }
+            continue;
+        }
+
+        // every output but the last gets a duplicate, which leaves the data where it is
+        int partial = 0;
+        for (int i = 0; i < count - 1; i++) {
+            sent[i] = turtle_fan_tee(src, out_fds[i], is_pipe[i], side, length);
+            partial |= sent[i] < length;
+        }
+
+        // the last output takes the data itself
+        size_t left = length;
+        if (!partial) {
+            while (left > 0) {
+                ssize_t moved = splice(src, NULL, out_fds[count - 1], NULL, left, SPLICE_F_MOVE);
+                if (moved <= 0) {
+                    break;
+                }
+                left -= moved;
+            }
+            if (left == 0) {
+                continue;
+            }
+        }
+
+        // an output that was full took only part of its copy, or the last one will not take a
+        // splice, so what is still in the pipe comes out through a buffer
+        buffer = buffer == NULL ? malloc(MOVE_CHUNK) : buffer;
+        if (turtle_fan_take(src, buffer + length - left, left) < 0) {
+            total = -1;
+            break;
+        }
+        for (int i = 0; partial && i < count - 1; i++) {
+            if (sent[i] < length) {
+                turtle_write_all(out_fds[i], buffer + sent[i], length - sent[i]);
+            }
+        }
+        if (turtle_write_all(out_fds[count - 1], buffer + length - left, left) < 0) {
+            total = -1;
+            break;
+        }
+    }
+
+    turtle_trace_end("fan out", copying ? "read/write" : "tee", trace_start, total);
+    if (feed[1] >= 0) {
+        close(feed[0]);
+        close(feed[1]);
+    }
+    close(side[0]);
+    close(side[1]);
+    free(buffer);
+    free(sent);
+    free(is_pipe);
+    return total;
+}
+
+int turtle_execute_single(struct Job* job, struct Command* cmd, int in_fd, int out_fd, enum mode mode_type) {
+    cmd->status_type = RUNNING;
+    struct Sink sink;
+    struct rusage before;
+
+    // cat and tee run inside the shell when they are all that is left of a foreground job;
+    // anywhere else nothing would read their output yet, or a stage before them may need the
+    // terminal the shell is holding, so they get a child of their own
+    if (turtle_is_mover(cmd->cmd_type)) {
+        uint64_t trace_start = turtle_trace_begin();
+        if (mode_type == FOREGROUND && job->pgid <= 0) {
+            turtle_account_start(cmd, &before);
+            cmd->exit_code = turtle_run_mover(cmd, in_fd, out_fd);
+            turtle_account_end(cmd, &before);
+            cmd->status_type = DONE;
+        } else {
+            // the child is timed from here just like one started by turtle_launch
+            clock_gettime(CLOCK_MONOTONIC, &cmd->start_time);
+            fflush(stdout);
+            pid_t child = fork();
+            if (child == 0) {
+                signal(SIGINT, SIG_DFL);
+                signal(SIGQUIT, SIG_DFL);
+                signal(SIGTSTP, SIG_DFL);
+                signal(SIGTTIN, SIG_DFL);
+                signal(SIGTTOU, SIG_DFL);
+                setpgid(0, job->pgid > 0 ? job->pgid : getpid());
+
+                // holding on to the read end of its own pipe would keep it from ever seeing the reader leave
+                dup2(in_fd, STDIN_FILENO);
+                dup2(out_fd, STDOUT_FILENO);
+                close_range(3, ~0U, 0);
+                _exit(turtle_run_mover(cmd, STDIN_FILENO, STDOUT_FILENO));
+            } else if (child > 0) {
+                cmd->pid = child;
+                if (job->pgid <= 0) {
+                    job->pgid = child;
+                }
+                setpgid(child, job->pgid);
+                turtle_index_pid(cmd);
+            } else {
+                cmd->exit_code = 1;
+                cmd->status_type = DONE;
+            }
+        }
+        turtle_trace_end("mover", cmd->argv[0], trace_start, cmd->exit_code);
+        turtle_close_fds(in_fd, out_fd);
+        return turtle_wait_foreground(job, mode_type);
+    }
+
+    // the utilities need no process of their own, but may end a pipeline that has to be waited on
+    if (turtle_is_utility(cmd->cmd_type)) {
+        uint64_t trace_start = turtle_trace_begin();
+        turtle_account_start(cmd, &before);
+        FILE* out = turtle_sink_open(&sink, out_fd, mode_type == PIPELINE);
+        cmd->exit_code = turtle_run_utility(cmd, out);
+        turtle_account_end(cmd, &before);
+        turtle_trace_end("utility", cmd->argv[0], trace_start, cmd->exit_code);
+        turtle_sink_finish(job, cmd, &sink);
+        turtle_close_fds(in_fd, out_fd);
+        return turtle_wait_foreground(job, mode_type);
+    }
+
+    // check if the command is any of the builtins
+    if (cmd->cmd_type != EXTERNAL) {
+        int builtin_ret;
+        uint64_t trace_start = turtle_trace_begin();
+        turtle_account_start(cmd, &before);
+        if (out_fd == 1) {
+            builtin_ret = turtle_execute_builtin(cmd, in_fd, out_fd);
+            turtle_account_end(cmd, &before);
+            cmd->exit_code = builtin_ret < 0 ? 1 : 0;
+            cmd->status_type = DONE;
+        } else {
+            // builtins print with printf, so stdout is pointed at the sink while one runs
+            FILE* saved_stdout = stdout;
+            stdout = turtle_sink_open(&sink, out_fd, mode_type == PIPELINE);
+            builtin_ret = turtle_execute_builtin(cmd, in_fd, out_fd);
+            stdout = saved_stdout;
+            turtle_account_end(cmd, &before);
+            cmd->exit_code = builtin_ret < 0 ? 1 : 0;
+            turtle_sink_finish(job, cmd, &sink);
+        }
+        turtle_trace_end("builtin", cmd->argv[0], trace_start, builtin_ret);
+        turtle_close_fds(in_fd, out_fd);
+        if (turtle_wait_foreground(job, mode_type) < 0) {
+            return -1;
+        }
+        return builtin_ret;
+    }
+
+    // check if the command is assigning a variable
+    for (int i = 0; i < strlen(cmd->argv[0]); i++) {
+        if (cmd->argv[0][i] == '=') {
+            // a new PATH makes every remembered location stale
+            if (strncmp(cmd->argv[0], "PATH=", 5) == 0) {
+                turtle_hash_clear();
+            }
+            putenv(strdup(cmd->argv[0]));
+            turtle_close_fds(in_fd, out_fd);
+            return 1;
+        }
+    }
+
+    // resolve the command in the parent so the lookup is remembered
+    char* exec_path = cmd->argv[0];
+    if (strchr(cmd->argv[0], '/') == NULL) {
+        exec_path = turtle_hash_lookup(cmd->argv[0]);
+    }
+
+    if (exec_path == NULL) {
+        fprintf(stderr, "turtle could not find command: %s\n", cmd->argv[0]);
+        cmd->exit_code = 127;
+        cmd->status_type = DONE;
+    } else if (turtle_arg_bytes(cmd->argv) > turtle_arg_limit()) {
+        fprintf(stderr, "turtle: argument list too long for %s, try batch or autobatch on\n", cmd->argv[0]);
+        cmd->exit_code = 126;
+        cmd->status_type = DONE;
+    } else {
+        pid_t child = turtle_launch(job, cmd, exec_path, in_fd, out_fd);
+        if (child < 0) {
+            cmd->status_type = DONE;
+        } else {
+            cmd->pid = child;
+            if (job->pgid <= 0) {
+                job->pgid = cmd->pid;
+            }
+            setpgid(child, job->pgid);
+            turtle_index_pid(cmd);
+        }
+    }
+    turtle_close_fds(in_fd, out_fd);
+    return turtle_wait_foreground(job, mode_type);
+}
+
+// wait for a job that was started in the foreground, handing it the terminal meanwhile
+int turtle_wait_foreground(struct Job* job, enum mode mode_type) {
+    int exec_ret = 0;
+    if (mode_type == FOREGROUND && job->pgid > 0) {
+        if (shell->interactive) {
+            tcsetpgrp(0, job->pgid);
+        }
+        exec_ret = turtle_wait_job(job->id);
+        if (shell->interactive) {
+            signal(SIGTTOU, SIG_IGN);
+            tcsetpgrp(0, getpid());
+            signal(SIGTTOU, SIG_DFL);
+        }
+    }
+
+    return exec_ret;
+}
+
+// start an external command with the current engine, timing how long the launch takes
+pid_t turtle_launch(struct Job* job, struct Command* cmd, char* exec_path, int in_fd, int out_fd) {
+    struct timespec start, end;
+    pid_t child;
+
+    // anything the shell printed must come out before the child's output
+    fflush(stdout);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    cmd->start_time = start;
+    if (turtle_engine == SPAWN_ENGINE) {
+        child = turtle_launch_spawn(job, cmd, exec_path, in_fd, out_fd);
+    } else if (turtle_engine == VFORK_ENGINE) {
+        child = turtle_launch_vfork(job, cmd, exec_path, in_fd, out_fd);
+    } else {
+        child = turtle_launch_fork(job, cmd, exec_path, in_fd, out_fd);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (turtle_trace.enabled) {
+        const char* engine_names[NUM_ENGINES] = {"fork", "vfork", "spawn"};
+        turtle_trace_span("launch", engine_names[turtle_engine],
+                          start.tv_sec * 1000000000ULL + start.tv_nsec,
+                          end.tv_sec * 1000000000ULL + end.tv_nsec, turtle_trace.pid, child);
+    }
+
+    if (child > 0) {
+        turtle_engine_stats[turtle_engine].launches++;
+        turtle_engine_stats[turtle_engine].total_ns +=
+            (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+    }
+    return child;
+}
+
+// the original engine: copy the whole shell and set the child up by hand
+pid_t turtle_launch_fork(struct Job* job, struct Command* cmd, char* exec_path, int in_fd, int out_fd) {
+    pid_t child = fork();
+
+    if (child == 0) {
+        // restore all the signals
+        signal(SIGINT, SIG_DFL);
+        signal(SIGQUIT, SIG_DFL);
+        signal(SIGTSTP, SIG_DFL);
+        signal(SIGTTIN, SIG_DFL);
+        signal(SIGTTOU, SIG_DFL);
+        signal(SIGCHLD, SIG_DFL);
+        sigset_t no_signals;
+        sigemptyset(&no_signals);
+        sigprocmask(SIG_SETMASK, &no_signals, NULL);
+
+        // set this cmd's pid and process group
+        cmd->pid = getpid();
+        if (job->pgid <= 0) {
+            job->pgid = cmd->pid;
+        }
+        setpgid(0, job->pgid);
+
+        // check for input redirection
+        if (in_fd != 0) {
+            dup2(in_fd, 0);
+            close(in_fd);
+        }
+
+        // check for output redirection
+        if (out_fd != 1) {
+            dup2(out_fd, 1);
+            close(out_fd);
+        }
+
+        execv(exec_path, cmd->argv);
+        int error = errno;
+        if (error == ENOEXEC) {
+            char* sh_argv[cmd->argc + 2];
+            turtle_script_argv(cmd, exec_path, sh_argv);
+            execv("/bin/sh", sh_argv);
+        }
+        fprintf(stderr, "turtle: %s: %s\n", cmd->argv[0], strerror(error));
+        _exit(turtle_exec_status(error));
+    }
+
+    return child;
+}
+
+// share the shell's memory until the child execs, so no page tables are copied
+// the child may only make system calls here since it runs on our stack
+pid_t turtle_launch_vfork(struct Job* job, struct Command* cmd, char* exec_path, int in_fd, int out_fd) {
+    pid_t pgid = job->pgid > 0 ? job->pgid : 0;
+    char message[MAX_PATH_LENGTH];
+    int message_length = snprintf(message, sizeof(message), "turtle: %s: ", cmd->argv[0]);
+    if (message_length >= sizeof(message)) {
+        message_length = sizeof(message) - 1;
+    }
+    char* sh_argv[cmd->argc + 2];
+    turtle_script_argv(cmd, exec_path, sh_argv);
+
+    struct sigaction act_default;
+    memset(&act_default, 0, sizeof(act_default));
+    act_default.sa_handler = SIG_DFL;
+    sigset_t no_signals;
+    sigemptyset(&no_signals);
+
+    pid_t child = vfork();
+
+    if (child == 0) {
+        // restore all the signals
+        sigaction(SIGINT, &act_default, NULL);
+        sigaction(SIGQUIT, &act_default, NULL);
+        sigaction(SIGTSTP, &act_default, NULL);
+        sigaction(SIGTTIN, &act_default, NULL);
+        sigaction(SIGTTOU, &act_default, NULL);
+        sigaction(SIGCHLD, &act_default, NULL);
+        sigprocmask(SIG_SETMASK, &no_signals, NULL);
+
+        setpgid(0, pgid);
+
+        if (in_fd != 0) {
+            dup2(in_fd, 0);
+            close(in_fd);
+        }
+        if (out_fd != 1) {
+            dup2(out_fd, 1);
+            close(out_fd);
+        }
+
+        execv(exec_path, cmd->argv);
+        int error = errno;
+        if (error == ENOEXEC) {
+            execv("/bin/sh", sh_argv);
+        }
+
+        // strerrordesc_np only looks in a table, unlike strerror, which may translate and allocate
+        const char* reason = strerrordesc_np(error);
+        write(STDERR_FILENO, message, message_length);
+        write(STDERR_FILENO, reason, strlen(reason));
+        write(STDERR_FILENO, "\n", 1);
+        _exit(turtle_exec_status(error));
+    }
+
+    return child;
+}
+
+// let libc create the child with the process group, signals, and fds described up front
+pid_t turtle_launch_spawn(struct Job* job, struct Command* cmd, char* exec_path, int in_fd, int out_fd) {
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    sigset_t default_signals, no_signals;
+    pid_t child = -1;
+
+    sigemptyset(&default_signals);
+    sigaddset(&default_signals, SIGINT);
+    sigaddset(&default_signals, SIGQUIT);
+    sigaddset(&default_signals, SIGTSTP);
+    sigaddset(&default_signals, SIGTTIN);
+    sigaddset(&default_signals, SIGTTOU);
+    sigaddset(&default_signals, SIGCHLD);
+    sigemptyset(&no_signals);
+
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+    posix_spawnattr_setpgroup(&attr, job->pgid > 0 ? job->pgid : 0);
+    posix_spawnattr_setsigdefault(&attr, &default_signals);
+    posix_spawnattr_setsigmask(&attr, &no_signals);
+
+    posix_spawn_file_actions_init(&actions);
+    if (in_fd != 0) {
+        posix_spawn_file_actions_adddup2(&actions, in_fd, 0);
+        posix_spawn_file_actions_addclose(&actions, in_fd);
+    }
+    if (out_fd != 1) {
+        posix_spawn_file_actions_adddup2(&actions, out_fd, 1);
+        posix_spawn_file_actions_addclose(&actions, out_fd);
+    }
+
+    int error = posix_spawn(&child, exec_path, &actions, &attr, cmd->argv, environ);
+    if (error == ENOEXEC) {
+        // posix_spawn, unlike execvp, does not hand a script without a #! line to the shell
+        char* sh_argv[cmd->argc + 2];
+        turtle_script_argv(cmd, exec_path, sh_argv);
+        error = posix_spawn(&child, "/bin/sh", &actions, &attr, sh_argv, environ);
+    }
+
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    if (error == ENOENT || error == EACCES || error == ENOEXEC || error == ENOTDIR || error == E2BIG) {
+        fprintf(stderr, "turtle: %s: %s\n", cmd->argv[0], strerror(error));
+        cmd->exit_code = turtle_exec_status(error);
+        return -1;
+    } else if (error != 0) {
+        // spawn itself could not run, so fall back to a plain fork
+        return turtle_launch_fork(job, cmd, exec_path, in_fd, out_fd);
+    }
+
+    return child;
+}
+
+// run a file that exec would not take as a script for /bin/sh, as sh does: sh path args...
+// sh_argv must have room for argc + 2 pointers
+void turtle_script_argv(struct Command* cmd, char* exec_path, char** sh_argv) {
+    sh_argv[0] = "sh";
+    sh_argv[1] = exec_path;
+    for (int i = 1; i < cmd->argc; i++) {
+        sh_argv[i + 1] = cmd->argv[i];
+    }
+    sh_argv[cmd->argc + 1] = NULL;
+}
+
+// exit status for a command exec could not run: 127 if it is not there, 126 if it cannot be run
+int turtle_exec_status(int error) {
+    return error == ENOENT || error == ENOTDIR ? 127 : 126;
+}
+
+int turtle_wait_job(int id) {
+    struct Job* job = turtle_get_job(id);
+    if (job == NULL) {
+        return -1;
+    }
+
+    // every child is reaped as it ends, not just this job's, so finish times stay exact
+    uint64_t trace_start = turtle_trace_begin();
+    job->waited = 1;
+    while (1) {
+        int running = 0;
+        for (struct Command* cur_cmd = job->root; cur_cmd != NULL; cur_cmd = cur_cmd->next) {
+            if (cur_cmd->pid > 0 && (cur_cmd->status_type == RUNNING || cur_cmd->status_type == CONTINUED)) {
+                running++;
+            }
+        }
+        if (running == 0) {
+            break;
+        }
+
+        int status;
+        struct rusage usage;
+        pid_t pid = wait4(-1, &status, WUNTRACED, &usage);
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        turtle_child_changed(pid, status, &usage);
+    }
+    job->waited = 0;
+    turtle_trace_end("wait", NULL, trace_start, id);
+
+    // a stopped job stays in the table to be continued later
+    struct Command* last = job->root;
+    int stopped = 0;
+    for (struct Command* cur_cmd = job->root; cur_cmd != NULL; cur_cmd = cur_cmd->next) {
+        if (cur_cmd->status_type == SUSPENDED) {
+            stopped = 1;
+        }
+        last = cur_cmd;
+    }
+    if (stopped) {
+        turtle_print_job_status(id, 0);
+        return -1;
+    }
+    return last->exit_code;
+}
+
+// drain the signalfd and reap children if any SIGCHLD arrived
+void turtle_check_children() {
+    struct signalfd_siginfo info;
+    int signaled = 0;
+
+    while (read(shell->child_fd, &info, sizeof(info)) == sizeof(info)) {
+        signaled = 1;
+    }
+    if (signaled) {
+        turtle_reap_children();
+    }
+}
+
+// collect every child that changed state without blocking, and release
+// jobs whose commands have all finished so nothing lingers as a zombie
+void turtle_reap_children() {
+    int status;
+    struct rusage usage;
+    pid_t pid;
+
+    while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage)) > 0) {
+        turtle_child_changed(pid, status, &usage);
+    }
+}
+
+// record what happened to one of our children
+// returns its command, or NULL if the child was unknown or its job has now been released
+struct Command* turtle_child_changed(pid_t pid, int status, struct rusage* usage) {
+    struct Command* cmd = turtle_find_pid(pid);
+    if (cmd == NULL) {
+        return NULL;
+    }
+    turtle_record_status(cmd, status, usage);
+
+    // only jobs in the table are ours to release, and not while a builtin is waiting on them
+    struct Job* job = cmd->job;
+    if (turtle_get_job(job->id) != job || job->waited || !turtle_job_finished(job)) {
+        return cmd;
+    }
+
+    if (shell->interactive) {
+        turtle_add_notice(job);
+    }
+    turtle_remove_job(job->id);
+    return NULL;
+}
+
+// note how a child changed, and once it has ended, when and what it used
+void turtle_record_status(struct Command* cmd, int status, struct rusage* usage) {
+    if (WIFSTOPPED(status)) {
+        cmd->status_type = SUSPENDED;
+        return;
+    } else if (WIFCONTINUED(status)) {
+        cmd->status_type = CONTINUED;
+        return;
+    } else if (WIFEXITED(status)) {
+        cmd->status_type = DONE;
+        cmd->exit_code = WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        cmd->status_type = TERMINATED;
+        cmd->exit_code = 128 + WTERMSIG(status);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &cmd->end_time);
+    if (usage != NULL) {
+        cmd->usage = *usage;
+    }
+
+    // each child gets its own row in the trace, next to the shell's
+    if (turtle_trace.enabled) {
+        turtle_trace_span("child", cmd->argv[0],
+                          cmd->start_time.tv_sec * 1000000000ULL + cmd->start_time.tv_nsec,
+                          cmd->end_time.tv_sec * 1000000000ULL + cmd->end_time.tv_nsec, cmd->pid, cmd->exit_code);
+    }
+}
+
+// start measuring a command that runs inside the shell
+void turtle_account_start(struct Command* cmd, struct rusage* before) {
+    clock_gettime(CLOCK_MONOTONIC, &cmd->start_time);
+    getrusage(RUSAGE_THREAD, before);
+}
+
+// charge a command that ran inside the shell with what the shell used meanwhile
+void turtle_account_end(struct Command* cmd, struct rusage* before) {
+    struct rusage after;
+    clock_gettime(CLOCK_MONOTONIC, &cmd->end_time);
+    getrusage(RUSAGE_THREAD, &after);
+
+    timersub(&after.ru_utime, &before->ru_utime, &cmd->usage.ru_utime);
+    timersub(&after.ru_stime, &before->ru_stime, &cmd->usage.ru_stime);
+    cmd->usage.ru_maxrss = after.ru_maxrss;
+    cmd->usage.ru_nvcsw = after.ru_nvcsw - before->ru_nvcsw;
+    cmd->usage.ru_nivcsw = after.ru_nivcsw - before->ru_nivcsw;
+}
+
+double turtle_seconds(struct timespec* start, struct timespec* end) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// one line of what a finished command used: wall, user and system time, peak memory,
+// and voluntary/involuntary context switches
+void turtle_print_stage_usage(FILE* out, struct Command* cmd) {
+    fprintf(out, "%9.3fs %9.3fs %9.3fs %10.1f MiB %7ld/%ld",
+            turtle_seconds(&cmd->start_time, &cmd->end_time),
+            cmd->usage.ru_utime.tv_sec + cmd->usage.ru_utime.tv_usec / 1e6,
+            cmd->usage.ru_stime.tv_sec + cmd->usage.ru_stime.tv_usec / 1e6,
+            cmd->usage.ru_maxrss / 1024.0, cmd->usage.ru_nvcsw, cmd->usage.ru_nivcsw);
+}
+
+// report what every command of a job used and what the job used as a whole
+void turtle_print_usage(FILE* out, struct Job* job) {
+    struct timespec first = {0, 0}, last = {0, 0};
+    struct Command total;
+    memset(&total, 0, sizeof(total));
+
+    fprintf(out, "      wall       user        sys        max rss  switches  command\n");
+    for (struct Command* cur_cmd = job->root; cur_cmd != NULL; cur_cmd = cur_cmd->next) {
+        if (cur_cmd->status_type != DONE && cur_cmd->status_type != TERMINATED) {
+            continue;
+        }
+        turtle_print_stage_usage(out, cur_cmd);
+        fprintf(out, "  ");
+        for (int i = 0; i < cur_cmd->argc; i++) {
+            fprintf(out, "%s ", cur_cmd->argv[i]);
+        }
+        fprintf(out, "\n");
+
+        // the job runs from its first start to its last finish, the rest adds up
+        if (first.tv_sec == 0 || turtle_seconds(&cur_cmd->start_time, &first) > 0) {
+            first = cur_cmd->start_time;
+        }
+        if (turtle_seconds(&last, &cur_cmd->end_time) > 0) {
+            last = cur_cmd->end_time;
+        }
+        timeradd(&total.usage.ru_utime, &cur_cmd->usage.ru_utime, &total.usage.ru_utime);
+        timeradd(&total.usage.ru_stime, &cur_cmd->usage.ru_stime, &total.usage.ru_stime);
+        if (cur_cmd->usage.ru_maxrss > total.usage.ru_maxrss) {
+            total.usage.ru_maxrss = cur_cmd->usage.ru_maxrss;
+        }
+        total.usage.ru_nvcsw += cur_cmd->usage.ru_nvcsw;
+        total.usage.ru_nivcsw += cur_cmd->usage.ru_nivcsw;
+    }
+
+    total.start_time = first;
+    total.end_time = last;
+    turtle_print_stage_usage(out, &total);
+    fprintf(out, "  total\n");
+}
+
+// get a pool ready to run the commands of job, at most max_running at a time, reading in_fd and writing out_fd
+// with group_output each command's output is held back and printed in one piece when it finishes
+void turtle_pool_init(struct Pool* pool, struct Job* job, int max_running, int group_output, int in_fd, int out_fd) {
+    memset(pool, 0, sizeof(struct Pool));
+    pool->job = job;
+    pool->max_running = max_running > 0 ? max_running : 1;
+    pool->group_output = group_output;
+    pool->in_fd = in_fd;
+    pool->out_fd = out_fd;
+    pool->slots = turtle_arena_alloc(&job->arena, pool->max_running * sizeof(struct Pool_Slot));
+
+    // a pipe whose reader has not been started yet could fill up and stall every command,
+    // so their output is held back and goes through the builtin's sink instead
+    struct stat info;
+    if (out_fd != STDOUT_FILENO && fstat(out_fd, &info) == 0 && S_ISFIFO(info.st_mode)) {
+        pool->group_output = 1;
+    }
+
+    // the commands share the shell's process group, so they never join a group that is gone;
+    // ctrl-c reaches them as it would any foreground command, and the pool starts no more
+    job->pgid = getpgrp();
+    job->waited = 1;
+}
+
+// start cmd as soon as a slot is free
+// returns -1 if the pool was interrupted and cmd was not started
+int turtle_pool_submit(struct Pool* pool, struct Command* cmd, char* exec_path) {
+    while (pool->running >= pool->max_running && !pool->interrupted) {
+        if (turtle_pool_wait(pool) < 0) {
+            break;
+        }
+    }
+    if (pool->interrupted) {
+        return -1;
+    }
+
+    // find an empty slot for this command
+    struct Pool_Slot* slot = pool->slots;
+    while (slot->cmd != NULL) {
+        slot++;
+    }
+
+    int out_fd = pool->out_fd;
+    if (pool->group_output) {
+        out_fd = memfd_create("turtle-output", MFD_CLOEXEC);
+        if (out_fd < 0) {
+            out_fd = pool->out_fd;
+        }
+    }
+
+    cmd->status_type = RUNNING;
+    pid_t child = turtle_launch(pool->job, cmd, exec_path, pool->in_fd, out_fd);
     if (child < 0) {
+        cmd->status_type = DONE;
+        cmd->exit_code = 127;
+        if (out_fd != pool->out_fd) {
+            close(out_fd);
+        }
+        return 0;
+    }
+
+    cmd->pid = child;
+    turtle_index_pid(cmd);
+    slot->cmd = cmd;
+    slot->out_fd = out_fd;
+    pool->running++;
+    return 0;
+}
+
+// wait for one of the pool's commands to finish, keeping the rest of the job table up to date
+// returns -1 once there are no children left to wait for
+int turtle_pool_wait(struct Pool* pool) {
+    int status;
+    struct rusage usage;
+
+    while (1) {
+        pid_t pid = wait4(-1, &status, 0, &usage);
+        if (pid < 0) {
+            // ctrl-c stops new commands from starting, and the running ones get it too
+            if (errno == EINTR) {
+                pool->interrupted = 1;
+                continue;
+            }
+            return -1;
+        }
+
+        struct Command* cmd = turtle_child_changed(pid, status, &usage);
+        if (cmd == NULL || cmd->job != pool->job) {
+            continue;
+        }
+
+        for (int i = 0; i < pool->max_running; i++) {
+            struct Pool_Slot* slot = &pool->slots[i];
+            if (slot->cmd != cmd) {
+                continue;
+            }
+
+            // print held back output all at once so it never interleaves with another command;
+            // stdout is the builtin's sink whenever out_fd is not the terminal, so it lands in order there
+            if (slot->out_fd != pool->out_fd) {
+                char buffer[BUFSIZ];
+                ssize_t count;
+                lseek(slot->out_fd, 0, SEEK_SET);
+                while ((count = read(slot->out_fd, buffer, sizeof(buffer))) > 0) {
+                    fwrite(buffer, 1, count, stdout);
+                }
+                fflush(stdout);
+                close(slot->out_fd);
+            }
+            slot->cmd = NULL;
+            pool->running--;
+            break;
+        }
+        return 0;
+    }
+}
+
+// wait for every command in the pool to finish
+void turtle_pool_finish(struct Pool* pool) {
+    while (pool->running > 0) {
+        if (turtle_pool_wait(pool) < 0) {
+            break;
+        }
+    }
+    pool->job->waited = 0;
+}
+
+// a job is finished once none of its commands can run again
+int turtle_job_finished(struct Job* job) {
+    struct Command* cur_cmd = job->root;
+    while (cur_cmd != NULL) {
+        if (cur_cmd->status_type != DONE && cur_cmd->status_type != TERMINATED) {
+            return 0;
+        }
+        cur_cmd = cur_cmd->next;
+    }
+    return 1;
+}
+
+// remember that a job finished so we can say so before the next prompt
+void turtle_add_notice(struct Job* job) {
+    char* text = NULL;
+    size_t text_size = 0;
+    FILE* notice = open_memstream(&text, &text_size);
+    if (notice == NULL) {
+        return;
+    }
+
+    // the last command decides how the job as a whole ended
+    struct Command* last = job->root;
+    while (last->next != NULL) {
+        last = last->next;
+    }
+    fprintf(notice, "[%d]\t%s\t", job->id, last->status_type == DONE ? "done" : "terminated");
+
+    struct Command* cur_cmd = job->root;
+    while (cur_cmd != NULL) {
+        for (int i = 0; i < cur_cmd->argc; i++) {
+            fprintf(notice, "%s ", cur_cmd->argv[i]);
+        }
+        cur_cmd = cur_cmd->next;
+        if (cur_cmd != NULL) {
+            fprintf(notice, "| ");
+        }
+    }
+    if (job->timed || job->meters != NULL) {
+        fprintf(notice, "\n");
+        if (job->timed) {
+            turtle_print_usage(notice, job);
+        }
+        turtle_print_meters(notice, job);
+        // the notice is printed with its own newline
+        fseek(notice, -1, SEEK_CUR);
+    }
+    fclose(notice);
+
+    struct Notice* new_notice = calloc(sizeof(struct Notice), 1);
+    new_notice->text = text;
+
+    // keep them in the order the jobs finished
+    struct Notice** link = &shell->notices;
+    while (*link != NULL) {
+        link = &(*link)->next;
+    }
+    *link = new_notice;
+}
+
+void turtle_print_notices() {
+    while (shell->notices != NULL) {
+        struct Notice* temp = shell->notices->next;
+        printf("%s\n", shell->notices->text);
+        free(shell->notices->text);
+        free(shell->notices);
+        shell->notices = temp;
+    }
+}
+
+// remember which command a pid belongs to so reaping it is a single lookup
+void turtle_index_pid(struct Command* cmd) {
+    // keep the chains short by doubling the buckets once they average one entry
+    if (shell->pid_count >= shell->pid_index_size) {
+        int old_size = shell->pid_index_size;
+        struct Command** old_index = shell->pid_index;
+
+        shell->pid_index_size *= 2;
+        shell->pid_index = calloc(shell->pid_index_size, sizeof(struct Command*));
+        if (!shell->pid_index) {
+            fprintf(stderr, "turtle failed to allocate memory\n");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < old_size; i++) {
+            struct Command* entry = old_index[i];
+            while (entry != NULL) {
+                struct Command* temp = entry->pid_next;
+                int bucket = entry->pid & (shell->pid_index_size - 1);
+                entry->pid_next = shell->pid_index[bucket];
+                shell->pid_index[bucket] = entry;
+                entry = temp;
+            }
+        }
+        free(old_index);
+    }
+
+    int bucket = cmd->pid & (shell->pid_index_size - 1);
+    cmd->pid_next = shell->pid_index[bucket];
+    shell->pid_index[bucket] = cmd;
+    shell->pid_count++;
+}
+
+void turtle_unindex_pid(struct Command* cmd) {
+    struct Command** link = &shell->pid_index[cmd->pid & (shell->pid_index_size - 1)];
+    while (*link != NULL) {
+        if (*link == cmd) {
+            *link = cmd->pid_next;
+            cmd->pid_next = NULL;
+            shell->pid_count--;
+            return;
+        }
+        link = &(*link)->pid_next;
+    }
+}
+
+// find the command running as this pid, or NULL if we never started it
+struct Command* turtle_find_pid(pid_t pid) {
+    struct Command* entry = shell->pid_index[pid & (shell->pid_index_size - 1)];
+    while (entry != NULL) {
+        if (entry->pid == pid) {
+            return entry;
+        }
+        entry = entry->pid_next;
+    }
+    return NULL;
+}
+
+// with long_format, commands that have finished also show what they used
+int turtle_print_job_status(int id, int long_format) {
+    if (turtle_get_job(id) == NULL) {
         return -1;
-    } else if (child == 0) {
-        // restore all the signals
-        signal(SIGINT, SIG_DFL);
-        signal(SIGQUIT, SIG_DFL);
-        signal(SIGTSTP, SIG_DFL);
-        signal(SIGTTIN, SIG_DFL);
-        signal(SIGTTOU, SIG_DFL);
-        signal(SIGCHLD, SIG_DFL);
+    }
+
+    printf("[%d]", id);
+
+    struct Command* cur_cmd = shell->jobs[id]->root;
+    while (cur_cmd != NULL) {
+        printf("\t%d\t", cur_cmd->pid);
+        for(int i = 0; i < cur_cmd->argc; i++) {
+            printf("%s ", cur_cmd->argv[i]);
+        }
+        printf("\t");
+        switch(cur_cmd->status_type) {
+            case RUNNING:
+                printf("running");
+                break;
+            case DONE:
+                printf("done");
+                break;
+            case SUSPENDED:
+                printf("suspended");
+                break;
+            case CONTINUED:
+                printf("continued");
+                break;
+            case TERMINATED:
+                printf("terminated");
+                break;
+            case QUEUED:
+                printf("queued");
+                break;
+
+        }
+        if (long_format && (cur_cmd->status_type == DONE || cur_cmd->status_type == TERMINATED)) {
+            printf("\t");
+            turtle_print_stage_usage(stdout, cur_cmd);
+        }
+        cur_cmd = cur_cmd->next;
+        if (cur_cmd != NULL) {
+            printf("|\n");
+        } else {
+            printf("\n");
+        }
+    }
+    turtle_print_meters(stdout, shell->jobs[id]);
+    return 0;
+}
+
+// hash a command name into one of the buckets of the command table
+static unsigned int turtle_hash_index(char* name) {
+    unsigned int hash = 5381;
+    while (*name != '\0') {
+        hash = hash * 33 + (unsigned char) *name;
+        name++;
+    }
+    return hash % HASH_SIZE;
+}
+
+// walk each directory in $PATH looking for an executable with this name
+static char* turtle_hash_search_path(char* name) {
+    char* path_env = getenv("PATH");
+    if (path_env == NULL) {
+        path_env = "/bin:/usr/bin";
+    }
+
+    char candidate[MAX_PATH_LENGTH];
+    struct stat file_info;
+    char* dir = path_env;
+    while (1) {
+        char* end = strchr(dir, ':');
+        int dir_length = end ? end - dir : strlen(dir);
+
+        // an empty entry in PATH means the current directory
+        if (dir_length == 0) {
+            snprintf(candidate, sizeof(candidate), "%s", name);
+        } else {
+            snprintf(candidate, sizeof(candidate), "%.*s/%s", dir_length, dir, name);
+        }
+
+        if (stat(candidate, &file_info) == 0 && S_ISREG(file_info.st_mode)
+            && access(candidate, X_OK) == 0) {
+            return strdup(candidate);
+        }
+
+        if (end == NULL) {
+            break;
+        }
+        dir = end + 1;
+    }
+
+    return NULL;
+}
+
+// find the full path of an external command, searching PATH only on a miss
+char* turtle_hash_lookup(char* name) {
+    return turtle_hash_find(name, 1);
+}
+
+// find the full path of an external command, counting it as a hit only if it is about to be run
+char* turtle_hash_find(char* name, int hit) {
+    unsigned int bucket = turtle_hash_index(name);
+
+    // a remembered file that has since been removed or moved is forgotten, and PATH searched again
+    struct Hash_Entry** link = &turtle_hash_table[bucket];
+    while (*link != NULL) {
+        struct Hash_Entry* entry = *link;
+        if (strcmp(entry->name, name) == 0) {
+            if (access(entry->path, X_OK) == 0) {
+                entry->hits += hit;
+                return entry->path;
+            }
+            *link = entry->next;
+            free(entry->name);
+            free(entry->path);
+            free(entry);
+            break;
+        }
+        link = &entry->next;
+    }
+
+    char* path = turtle_hash_search_path(name);
+    if (path == NULL) {
+        return NULL;
+    }
+
+    struct Hash_Entry* entry = calloc(sizeof(struct Hash_Entry), 1);
+    entry->name = strdup(name);
+    entry->path = path;
+    entry->hits = hit;
+    entry->next = turtle_hash_table[bucket];
+    turtle_hash_table[bucket] = entry;
+    return path;
+}
+
+// forget every remembered command location
+void turtle_hash_clear() {
+    for (int i = 0; i < HASH_SIZE; i++) {
+        struct Hash_Entry* entry = turtle_hash_table[i];
+        while (entry != NULL) {
+            struct Hash_Entry* temp = entry->next;
+            free(entry->name);
+            free(entry->path);
+            free(entry);
+            entry = temp;
+        }
+        turtle_hash_table[i] = NULL;
+    }
+}
+
+static int turtle_glob_compare_names(const void* a, const void* b) {
+    return strcmp(((const struct Dir_Name*) a)->name, ((const struct Dir_Name*) b)->name);
+}
+
+static int turtle_glob_compare_paths(const void* a, const void* b) {
+    return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+static unsigned int turtle_glob_index(dev_t dev, ino_t ino) {
+    return (unsigned int) ((ino * 2654435761u) ^ dev) % GLOB_CACHE_SIZE;
+}
+
+// read every name in a directory into entry, sorted
+static int turtle_glob_read_dir(struct Dir_Entry* entry, const char* path) {
+    DIR* dir = opendir(path);
+    if (dir == NULL) {
+        return -1;
+    }
+
+    // names are packed into one pool, remembered by offset until the pool stops moving
+    size_t pool_size = 4096, pool_used = 0;
+    int names_size = 64, count = 0;
+    char* pool = malloc(pool_size);
+    struct Dir_Name* names = malloc(names_size * sizeof(struct Dir_Name));
+    struct dirent* dirent;
+    while ((dirent = readdir(dir)) != NULL) {
+        size_t length = strlen(dirent->d_name) + 1;
+        if (pool_used + length > pool_size) {
+            while (pool_used + length > pool_size) {
+                pool_size *= 2;
+            }
+            pool = realloc(pool, pool_size);
+        }
+        if (count == names_size) {
+            names_size *= 2;
+            names = realloc(names, names_size * sizeof(struct Dir_Name));
+        }
+        memcpy(pool + pool_used, dirent->d_name, length);
+        names[count].name = (char*) pool_used;
+        names[count].type = dirent->d_type;
+        pool_used += length;
+        count++;
+    }
+    closedir(dir);
+
+    for (int i = 0; i < count; i++) {
+        names[i].name = pool + (size_t) names[i].name;
+    }
+    qsort(names, count, sizeof(struct Dir_Name), turtle_glob_compare_names);
+
+    entry->names = names;
+    entry->count = count;
+    entry->pool = pool;
+    return 0;
+}
+
+// free a listing that has left the cache, or leave that to whichever walk unpins it last
+static void turtle_glob_drop(struct Dir_Entry* entry) {
+    turtle_glob_stats.dirs_cached--;
+    turtle_glob_stats.names_cached -= entry->count;
+    if (entry->pins > 0) {
+        entry->dropped = 1;
+        return;
+    }
+    free(entry->names);
+    free(entry->pool);
+    free(entry);
+}
+
+// done with a listing turtle_glob_dir returned
+void turtle_glob_unpin(struct Dir_Entry* entry) {
+    entry->pins--;
+    if (entry->pins == 0 && entry->dropped) {
+        free(entry->names);
+        free(entry->pool);
+        free(entry);
+    }
+}
+
+// get the names in a directory, reading it again only if it changed since it was cached
+// the listing is pinned, so it stays put until turtle_glob_unpin even if the cache lets go of it
+struct Dir_Entry* turtle_glob_dir(const char* path) {
+    struct stat dir_info;
+    if (stat(path, &dir_info) < 0 || !S_ISDIR(dir_info.st_mode)) {
+        return NULL;
+    }
+
+    unsigned int bucket = turtle_glob_index(dir_info.st_dev, dir_info.st_ino);
+    struct Dir_Entry** link = &turtle_glob_cache[bucket];
+    struct Dir_Entry* entry = *link;
+    while (entry != NULL && (entry->dev != dir_info.st_dev || entry->ino != dir_info.st_ino)) {
+        link = &entry->next;
+        entry = *link;
+    }
+
+    // adding or removing a name always moves the directory's mtime, and ctime catches it being replaced
+    if (entry != NULL && !entry->racy
+        && entry->mtime.tv_sec == dir_info.st_mtim.tv_sec && entry->mtime.tv_nsec == dir_info.st_mtim.tv_nsec
+        && entry->ctime.tv_sec == dir_info.st_ctim.tv_sec && entry->ctime.tv_nsec == dir_info.st_ctim.tv_nsec) {
+        turtle_glob_stats.hits++;
+        entry->pins++;
+        return entry;
+    }
+    turtle_glob_stats.misses++;
+
+    // the directory changed, so throw away the old listing
+    if (entry != NULL) {
+        *link = entry->next;
+        turtle_glob_drop(entry);
+    }
+    if (turtle_glob_stats.dirs_cached >= GLOB_CACHE_MAX_DIRS) {
+        turtle_glob_clear();
+    }
 
-        // set this cmd's pid and process group
-        cmd->pid = getpid();
-        if (job->pgid <= 0) {
-            job->pgid = cmd->pid;
+    entry = calloc(sizeof(struct Dir_Entry), 1);
+    if (turtle_glob_read_dir(entry, path) < 0) {
+        free(entry);
+        return NULL;
+    }
+    entry->dev = dir_info.st_dev;
+    entry->ino = dir_info.st_ino;
+    entry->mtime = dir_info.st_mtim;
+    entry->ctime = dir_info.st_ctim;
+
+    // timestamps only tick every few milliseconds, so a change made in the same tick as this
+    // listing would leave them the same; listings that recent are not trusted next time
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    entry->racy = now.tv_sec - dir_info.st_mtim.tv_sec < 2 || now.tv_sec - dir_info.st_ctim.tv_sec < 2;
+
+    bucket = turtle_glob_index(entry->dev, entry->ino);
+    entry->next = turtle_glob_cache[bucket];
+    turtle_glob_cache[bucket] = entry;
+    turtle_glob_stats.dirs_cached++;
+    turtle_glob_stats.names_cached += entry->count;
+    entry->pins++;
+    return entry;
+}
+
+// hand a match to the caller, or hold on to it if the matches need sorting first
+static void turtle_glob_match(struct Glob_Walk* walk, size_t length) {
+    walk->count++;
+    if (walk->sorted) {
+        walk->stopped = walk->each(walk->path, walk->data);
+        return;
+    }
+    if (walk->count > walk->matches_size) {
+        walk->matches_size = walk->matches_size ? walk->matches_size * 2 : BUFFER_SIZE;
+        walk->matches = realloc(walk->matches, walk->matches_size * sizeof(char*));
+    }
+    walk->matches[walk->count - 1] = strndup(walk->path, length);
+}
+
+// does path name a directory, asking the file system only when the listing could not say
+static int turtle_glob_is_dir(const char* path, unsigned char type) {
+    struct stat file_info;
+    if (type == DT_DIR) {
+        return 1;
+    }
+    if (type != DT_LNK && type != DT_UNKNOWN) {
+        return 0;
+    }
+    return stat(path, &file_info) == 0 && S_ISDIR(file_info.st_mode);
+}
+
+// match the rest of the pattern against what lies under the first length bytes of walk->path
+static void turtle_glob_walk(struct Glob_Walk* walk, size_t length, const char* pattern) {
+    if (walk->stopped) {
+        return;
+    }
+
+    const char* end = strchr(pattern, '/');
+    size_t part_length = end ? (size_t) (end - pattern) : strlen(pattern);
+    const char* rest = end;
+    while (rest != NULL && *rest == '/') {
+        rest++;
+    }
+    int last = rest == NULL || *rest == '\0';
+    int want_dir = rest != NULL && *rest == '\0';
+
+    char part[MAX_PATH_LENGTH];
+    if (part_length >= sizeof(part) || length + part_length + 2 >= MAX_PATH_LENGTH) {
+        return;
+    }
+    memcpy(part, pattern, part_length);
+    part[part_length] = '\0';
+
+    // ** matches any number of directories, which takes walking the whole tree
+    if (strcmp(part, "**") == 0) {
+        turtle_glob_tree(walk, length, end != NULL ? rest : NULL);
+        return;
+    }
+
+    // a part with no wildcards names one path, there is no need to list anything;
+    // one with an escaped character is left to fnmatch, which takes the escape away
+    if (strpbrk(part, "*?[\\") == NULL) {
+        memcpy(walk->path + length, part, part_length + 1);
+        size_t new_length = length + part_length;
+        if (!last) {
+            walk->path[new_length++] = '/';
+            walk->path[new_length] = '\0';
+            turtle_glob_walk(walk, new_length, rest);
+            return;
         }
-        setpgid(0, job->pgid);
 
-        // check for input redirection
-        if (in_fd != 0) {
-            dup2(in_fd, 0);
-            close(in_fd);
+        struct stat file_info;
+        if (want_dir ? turtle_glob_is_dir(walk->path, DT_UNKNOWN) : lstat(walk->path, &file_info) == 0) {
+            if (want_dir) {
+                walk->path[new_length++] = '/';
+                walk->path[new_length] = '\0';
+            }
+            turtle_glob_match(walk, new_length);
         }
+        return;
+    }
 
-        // check for output redirection
-        if (out_fd != 1) {
-            dup2(out_fd, 1);
-            close(out_fd);
+    walk->path[length] = '\0';
+    struct Dir_Entry* dir = turtle_glob_dir(length > 0 ? walk->path : ".");
+    if (dir == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < dir->count && !walk->stopped; i++) {
+        struct Dir_Name* name = &dir->names[i];
+        if (fnmatch(part, name->name, FNM_PERIOD) != 0) {
+            continue;
         }
 
-        execvp(cmd->argv[0], cmd->argv);
-        fprintf(stderr, "turtle could not find command: %s\n", cmd->argv[0]);
-        exit(0);
-    } else { // parent
-        cmd->pid = child;
-        if (job->pgid <= 0) {
-            job->pgid = cmd->pid;
+        size_t name_length = strlen(name->name);
+        if (length + name_length + 2 >= MAX_PATH_LENGTH) {
+            continue;
         }
-        setpgid(child, job->pgid);
+        memcpy(walk->path + length, name->name, name_length + 1);
+        size_t new_length = length + name_length;
 
-        // wait for this process to finish
-        if (mode_type == FOREGROUND) {
-            tcsetpgrp(0, job->pgid);
-            exec_ret = turtle_wait_job(job->id);
-            signal(SIGTTOU, SIG_IGN);
-            tcsetpgrp(0, getpid());
-            signal(SIGTTOU, SIG_DFL);
+        if (last && !want_dir) {
+            turtle_glob_match(walk, new_length);
+        } else if (turtle_glob_is_dir(walk->path, name->type)) {
+            walk->path[new_length++] = '/';
+            walk->path[new_length] = '\0';
+            if (last) {
+                turtle_glob_match(walk, new_length);
+            } else {
+                turtle_glob_walk(walk, new_length, rest);
+            }
         }
     }
+    turtle_glob_unpin(dir);
+}
 
-    return exec_ret;
+// put a directory on a walker's queue for some thread to read
+static void turtle_walk_push(struct Tree_Walk* tree, int id, char* path, int depth) {
+    struct Walk_Queue* queue = &tree->queues[id];
+    __atomic_add_fetch(&tree->pending, 1, __ATOMIC_SEQ_CST);
 
-}
+    pthread_mutex_lock(&queue->lock);
+    if (queue->tail == queue->size) {
+        // slide the unstolen directories back to the front before growing
+        if (queue->head > 0) {
+            memmove(queue->dirs, queue->dirs + queue->head, (queue->tail - queue->head) * sizeof(struct Walk_Dir));
+            queue->tail -= queue->head;
+            queue->head = 0;
+        }
+        if (queue->tail == queue->size) {
+            queue->size = queue->size ? queue->size * 2 : BUFFER_SIZE;
+            queue->dirs = realloc(queue->dirs, queue->size * sizeof(struct Walk_Dir));
+        }
+    }
+    queue->dirs[queue->tail].path = path;
+    queue->dirs[queue->tail].depth = depth;
+    queue->tail++;
+    pthread_mutex_unlock(&queue->lock);
 
-int turtle_wait_job(int id) {
-    if (id < 0 || id > MAX_NUM_JOBS || shell->jobs[id] == NULL) {
-        return -1;
+    // a thread that found every queue empty is asleep until there is something to take
+    pthread_mutex_lock(&tree->idle_lock);
+    if (tree->idle > 0) {
+        pthread_cond_signal(&tree->idle_cond);
     }
+    pthread_mutex_unlock(&tree->idle_lock);
+}
 
-    // find how many subcommands we need to wait on
-    int cmd_count = 0;
-    struct Command* cur_cmd = shell->jobs[id]->root;
-    while (cur_cmd != NULL) {
-        if (cur_cmd->status_type != DONE) {
-            cmd_count++;
+// is there a directory in any queue for an idle thread to take
+static int turtle_walk_queued(struct Tree_Walk* tree) {
+    for (int i = 0; i < tree->workers; i++) {
+        struct Walk_Queue* queue = &tree->queues[i];
+        pthread_mutex_lock(&queue->lock);
+        int queued = queue->head < queue->tail;
+        pthread_mutex_unlock(&queue->lock);
+        if (queued) {
+            return 1;
         }
-        cur_cmd = cur_cmd->next;
     }
+    return 0;
+}
 
-    int wait_pid = -1;
-    int wait_count = 0;
-    int status = 0;
+// take the newest directory from our own queue, or the oldest one from someone else's
+static int turtle_walk_pop(struct Tree_Walk* tree, int id, struct Walk_Dir* dir) {
+    for (int i = 0; i < tree->workers; i++) {
+        struct Walk_Queue* queue = &tree->queues[(id + i) % tree->workers];
+        pthread_mutex_lock(&queue->lock);
+        if (queue->head < queue->tail) {
+            if (i == 0) {
+                *dir = queue->dirs[--queue->tail];
+            } else {
+                *dir = queue->dirs[queue->head++];
+            }
+            pthread_mutex_unlock(&queue->lock);
+            return 1;
+        }
+        pthread_mutex_unlock(&queue->lock);
+    }
+    return 0;
+}
 
-    do {
-        wait_pid = waitpid(-shell->jobs[id]->pgid, &status, WUNTRACED);
-        wait_count++;
+// check one path found by the walk against the parts after the **
+static void turtle_walk_check(struct Walk_Worker* worker, char* path, int depth, int is_dir) {
+    struct Tree_Walk* tree = worker->tree;
+    if (tree->want_dir && !is_dir) {
+        return;
+    }
 
-        if (WIFEXITED(status)) {
-            turtle_set_status(wait_pid, DONE);
-        } else if (WIFSIGNALED(status)) {
-            turtle_set_status(wait_pid, TERMINATED);
-        } else if (WSTOPSIG(status)) {
-            status = -1;
-            turtle_set_status(wait_pid, SUSPENDED);
-            if (wait_count == cmd_count) {
-                turtle_print_job_status(wait_pid);
+    // ** soaks up every leading directory, so only the last few parts have to match
+    if (tree->pattern != NULL) {
+        if (depth < tree->parts) {
+            return;
+        }
+        char* suffix = path + strlen(path);
+        for (int slashes = 0; suffix > path; suffix--) {
+            if (suffix[-1] == '/' && ++slashes == tree->parts) {
+                break;
             }
         }
-    } while (wait_count < cmd_count);
+        if (fnmatch(tree->pattern, suffix, FNM_PATHNAME | FNM_PERIOD) != 0) {
+            return;
+        }
+    }
+
+    if (worker->count == worker->size) {
+        worker->size = worker->size ? worker->size * 2 : BUFFER_SIZE;
+        worker->matches = realloc(worker->matches, worker->size * sizeof(char*));
+    }
+    worker->matches[worker->count++] = strdup(path);
+}
+
+// read one directory, queueing the directories inside it and checking every name
+static void turtle_walk_dir(struct Walk_Worker* worker, struct Walk_Dir* dir, char* buffer) {
+    struct Tree_Walk* tree = worker->tree;
+    int fd = openat(tree->root_fd, dir->depth > 0 ? dir->path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+
+    size_t dir_length = strlen(dir->path);
+    ssize_t count;
+    while ((count = getdents64(fd, buffer, WALK_BUFFER)) > 0) {
+        for (ssize_t offset = 0; offset < count; ) {
+            struct dirent64* dirent = (struct dirent64*) (buffer + offset);
+            offset += dirent->d_reclen;
+            char* name = dirent->d_name;
+
+            // hidden names are never walked into, and only match a part that starts with a dot
+            if (name[0] == '.' && (tree->pattern == NULL || name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+
+            size_t name_length = strlen(name);
+            char* path = malloc(dir_length + name_length + 2);
+            if (dir->depth > 0) {
+                memcpy(path, dir->path, dir_length);
+                path[dir_length] = '/';
+                memcpy(path + dir_length + 1, name, name_length + 1);
+            } else {
+                memcpy(path, name, name_length + 1);
+            }
+
+            struct stat file_info;
+            int is_dir = dirent->d_type == DT_DIR;
+            if (dirent->d_type == DT_UNKNOWN) {
+                is_dir = fstatat(fd, name, &file_info, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(file_info.st_mode);
+            }
 
-    return status;
+            // links to directories can match, but are not walked into so the walk cannot loop
+            int links_dir = dirent->d_type == DT_LNK && tree->want_dir
+                            && fstatat(fd, name, &file_info, 0) == 0 && S_ISDIR(file_info.st_mode);
+            turtle_walk_check(worker, path, dir->depth + 1, is_dir || links_dir);
+            if (is_dir && name[0] != '.') {
+                turtle_walk_push(tree, worker->id, path, dir->depth + 1);
+            } else {
+                free(path);
+            }
+        }
+    }
+    close(fd);
 }
 
-int turtle_set_status(int pid, enum status status) {
-    struct Command* cur_cmd;
+// keep reading directories until every thread has run out of them
+void* turtle_walk_worker(void* arg) {
+    struct Walk_Worker* worker = arg;
+    struct Tree_Walk* tree = worker->tree;
+    char* buffer = malloc(WALK_BUFFER);
+    struct Walk_Dir dir;
 
-    for (int i = 1; i <= MAX_NUM_JOBS; i++) {
-        if (shell->jobs[i] == NULL) {
+    while (1) {
+        if (turtle_walk_pop(tree, worker->id, &dir)) {
+            turtle_walk_dir(worker, &dir, buffer);
+            free(dir.path);
+            if (__atomic_sub_fetch(&tree->pending, 1, __ATOMIC_SEQ_CST) == 0) {
+                // that was the last directory, so everyone asleep can leave
+                pthread_mutex_lock(&tree->idle_lock);
+                pthread_cond_broadcast(&tree->idle_cond);
+                pthread_mutex_unlock(&tree->idle_lock);
+            }
             continue;
         }
-        cur_cmd = shell->jobs[i]->root;
-        while (cur_cmd != NULL) {
-            if (cur_cmd->pid == pid) {
-                cur_cmd->status_type = status;
-                return 0;
+
+        // another thread is still reading and may queue more, so sleep until it does or the walk ends
+        pthread_mutex_lock(&tree->idle_lock);
+        tree->idle++;
+        while (__atomic_load_n(&tree->pending, __ATOMIC_SEQ_CST) > 0 && !turtle_walk_queued(tree)) {
+            pthread_cond_wait(&tree->idle_cond, &tree->idle_lock);
+        }
+        tree->idle--;
+        pthread_mutex_unlock(&tree->idle_lock);
+        if (__atomic_load_n(&tree->pending, __ATOMIC_SEQ_CST) == 0) {
+            break;
+        }
+    }
+
+    free(buffer);
+    return NULL;
+}
+
+// match everything under the first length bytes of walk->path against ** followed by rest
+// rest is NULL when ** was the last part, so every path under the directory matches
+void turtle_glob_tree(struct Glob_Walk* walk, size_t length, const char* rest) {
+    struct Tree_Walk tree;
+    memset(&tree, 0, sizeof(tree));
+
+    walk->path[length] = '\0';
+    tree.root_fd = open(length > 0 ? walk->path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (tree.root_fd < 0) {
+        return;
+    }
+
+    // a trailing slash asks for directories, the parts before it are matched as one pattern
+    if (rest != NULL) {
+        size_t rest_length = strlen(rest);
+        tree.want_dir = rest_length == 0 || rest[rest_length - 1] == '/';
+        while (rest_length > 0 && rest[rest_length - 1] == '/') {
+            rest_length--;
+        }
+        if (rest_length > 0) {
+            tree.pattern = strndup(rest, rest_length);
+            tree.parts = 1;
+            for (char* cur = tree.pattern; *cur != '\0'; cur++) {
+                if (*cur == '/' && cur[1] != '/' && cur[1] != '\0') {
+                    tree.parts++;
+                }
             }
-            cur_cmd = cur_cmd->next;
         }
     }
 
-    // couldn't find the process to change its status of
-    return -1;
+    int slots = sysconf(_SC_NPROCESSORS_ONLN);
+    if (slots < 1) {
+        slots = 1;
+    } else if (slots > WALK_MAX_THREADS) {
+        slots = WALK_MAX_THREADS;
+    }
+    tree.queues = calloc(slots, sizeof(struct Walk_Queue));
+    struct Walk_Worker* workers = calloc(slots, sizeof(struct Walk_Worker));
+    pthread_t* threads = calloc(slots, sizeof(pthread_t));
+    for (int i = 0; i < slots; i++) {
+        pthread_mutex_init(&tree.queues[i].lock, NULL);
+        workers[i].tree = &tree;
+        workers[i].id = i;
+    }
+    pthread_mutex_init(&tree.idle_lock, NULL);
+    pthread_cond_init(&tree.idle_cond, NULL);
+
+    // read the first directory alone, then start no more threads than it has directories to hand out
+    tree.workers = 1;
+    turtle_walk_push(&tree, 0, strdup(""), 0);
+    struct Walk_Dir first;
+    turtle_walk_pop(&tree, 0, &first);
+    char* buffer = malloc(WALK_BUFFER);
+    turtle_walk_dir(&workers[0], &first, buffer);
+    free(buffer);
+    free(first.path);
+    __atomic_sub_fetch(&tree.pending, 1, __ATOMIC_SEQ_CST);
+    tree.workers = tree.pending < slots ? (tree.pending > 0 ? tree.pending : 1) : slots;
+
+    // this thread walks too, alongside the helpers it starts
+    int started = 1;
+    while (started < tree.workers && pthread_create(&threads[started], NULL, turtle_walk_worker, &workers[started]) == 0) {
+        started++;
+    }
+    turtle_walk_worker(&workers[0]);
+    for (int i = 1; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // ** can match no directories at all, leaving the one it started in
+    if (tree.pattern == NULL && length > 0) {
+        turtle_glob_match(walk, tree.want_dir ? length : length - 1);
+    }
+
+    // hand every match back with the directory the ** started in in front of it
+    for (int i = 0; i < slots; i++) {
+        struct Walk_Worker* worker = &workers[i];
+        for (int j = 0; j < worker->count; j++) {
+            size_t match_length = strlen(worker->matches[j]);
+            if (length + match_length + 2 < MAX_PATH_LENGTH) {
+                memcpy(walk->path + length, worker->matches[j], match_length + 1);
+                if (tree.want_dir) {
+                    walk->path[length + match_length++] = '/';
+                    walk->path[length + match_length] = '\0';
+                }
+                turtle_glob_match(walk, length + match_length);
+            }
+            free(worker->matches[j]);
+        }
+        free(worker->matches);
+        pthread_mutex_destroy(&tree.queues[i].lock);
+        free(tree.queues[i].dirs);
+    }
+
+    pthread_mutex_destroy(&tree.idle_lock);
+    pthread_cond_destroy(&tree.idle_cond);
+    close(tree.root_fd);
+    free(tree.pattern);
+    free(tree.queues);
+    free(workers);
+    free(threads);
 }
 
-int turtle_print_job_status(int id) {
-    if (id < 0 || id > MAX_NUM_JOBS || shell->jobs[id] == NULL) {
-        return -1;
+// call each with every path matching pattern, in sorted order
+// returns how many paths matched
+// each can return nonzero to be given no more paths
+int turtle_glob_each(const char* pattern, int (*each)(const char* path, void* data), void* data) {
+    uint64_t trace_start = turtle_trace_begin();
+    struct Glob_Walk* walk = calloc(sizeof(struct Glob_Walk), 1);
+    walk->each = each;
+    walk->data = data;
+
+    // the cached listings are sorted, so when only the last part has wildcards
+    // the matches already come out in order and can go straight to the caller
+    const char* last_slash = strrchr(pattern, '/');
+    walk->sorted = strstr(pattern, "**") == NULL;
+    for (const char* cur = pattern; last_slash != NULL && cur < last_slash; cur++) {
+        if (*cur == '*' || *cur == '?' || *cur == '[') {
+            walk->sorted = 0;
+            break;
+        }
     }
 
-    printf("[%d]", id);
+    size_t length = 0;
+    if (*pattern == '/') {
+        walk->path[length++] = '/';
+        while (*pattern == '/') {
+            pattern++;
+        }
+    }
+    walk->path[length] = '\0';
+    turtle_glob_walk(walk, length, pattern);
 
-    struct Command* cur_cmd = shell->jobs[id]->root;
-    while (cur_cmd != NULL) {
-        printf("\t%d\t", cur_cmd->pid);
-        for(int i = 0; i < cur_cmd->argc; i++) {
-            printf("%s ", cur_cmd->argv[i]);
+    int count = walk->count;
+    if (!walk->sorted) {
+        qsort(walk->matches, count, sizeof(char*), turtle_glob_compare_paths);
+        for (int i = 0; i < count; i++) {
+            if (!walk->stopped) {
+                walk->stopped = each(walk->matches[i], data);
+            }
+            free(walk->matches[i]);
         }
-        printf("\t");
-        switch(cur_cmd->status_type) {
-            case RUNNING:
-                printf("running");
-                break;
-            case DONE:
-                printf("done");
-                break;
-            case SUSPENDED:
-                printf("suspended");
-                break;
-            case CONTINUED:
-                printf("continued");
-                break;
-            case TERMINATED:
-                printf("terminated");
-                break;
+        free(walk->matches);
+    }
+    free(walk);
+    turtle_trace_end("glob", pattern, trace_start, count);
+    return count;
+}
+
+// the pattern to glob a word with: its text, with a backslash before each quoted wildcard character
+char* turtle_glob_pattern(struct Arena* arena, struct Token* token) {
+    if (token->quoted == NULL) {
+        return token->text;
+    }
+
+    size_t length = strlen(token->text);
+    char* pattern = turtle_arena_alloc(arena, 2 * length + 1);
+    char* w = pattern;
+    for (size_t i = 0; i < length; i++) {
+        if (token->quoted[i]) {
+            *w++ = '\\';
+        }
+        *w++ = token->text[i];
+    }
+    *w = '\0';
+    return pattern;
+}
+
+// turn a pattern back into the word it came from, in place, for when nothing matched it
+void turtle_glob_literal(char* pattern) {
+    char* w = pattern;
+    for (char* r = pattern; *r != '\0'; r++) {
+        if (*r == '\\' && r[1] != '\0') {
+            r++;
+        }
+        *w++ = *r;
+    }
+    *w = '\0';
+}
+
+// forget every cached directory listing; ones a walk is still going through are freed when it finishes
+void turtle_glob_clear() {
+    for (int i = 0; i < GLOB_CACHE_SIZE; i++) {
+        struct Dir_Entry* entry = turtle_glob_cache[i];
+        while (entry != NULL) {
+            struct Dir_Entry* temp = entry->next;
+            turtle_glob_drop(entry);
+            entry = temp;
+        }
+        turtle_glob_cache[i] = NULL;
+    }
+}
+
+// hand out a block for an arena, reusing a released one when possible
+struct Arena_Block* turtle_arena_new_block(size_t size) {
+    struct Arena_Block* block = NULL;
+
+    if (size <= ARENA_BLOCK_SIZE && turtle_arena_free_list != NULL) {
+        block = turtle_arena_free_list;
+        turtle_arena_free_list = block->next;
+        turtle_arena_stats.blocks_cached--;
+    } else {
+        if (size < ARENA_BLOCK_SIZE) {
+            size = ARENA_BLOCK_SIZE;
+        }
+        block = malloc(sizeof(struct Arena_Block) + size);
+        if (!block) {
+            fprintf(stderr, "turtle failed to allocate memory\n");
+            exit(EXIT_FAILURE);
+        }
+        block->size = size;
+        turtle_arena_stats.block_mallocs++;
+    }
+
+    block->used = 0;
+    block->next = NULL;
+    turtle_arena_stats.blocks_live++;
+    return block;
+}
+
+// get zeroed memory that lives until the whole arena is released
+void* turtle_arena_alloc(struct Arena* arena, size_t size) {
+    // keep every allocation aligned for any type
+    size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+
+    struct Arena_Block* block = arena->head;
+    if (block == NULL || block->size - block->used < size) {
+        block = turtle_arena_new_block(size);
+        block->next = arena->head;
+        arena->head = block;
+    }
+
+    void* memory = block->data + block->used;
+    block->used += size;
+    memset(memory, 0, size);
+
+    turtle_arena_stats.allocations++;
+    turtle_arena_stats.bytes_live += size;
+    if (turtle_arena_stats.bytes_live > turtle_arena_stats.bytes_peak) {
+        turtle_arena_stats.bytes_peak = turtle_arena_stats.bytes_live;
+    }
+    return memory;
+}
+
+char* turtle_arena_strdup(struct Arena* arena, const char* string) {
+    size_t length = strlen(string) + 1;
+    char* copy = turtle_arena_alloc(arena, length);
+    memcpy(copy, string, length);
+    return copy;
+}
+
+// make an allocation bigger, extending it in place when it was the last one handed out
+void* turtle_arena_grow(struct Arena* arena, void* memory, size_t old_size, size_t new_size) {
+    old_size = (old_size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+    new_size = (new_size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
 
+    struct Arena_Block* block = arena->head;
+    if (block != NULL && (char*) memory + old_size == block->data + block->used
+        && block->size - block->used >= new_size - old_size) {
+        memset(block->data + block->used, 0, new_size - old_size);
+        block->used += new_size - old_size;
+        turtle_arena_stats.bytes_live += new_size - old_size;
+        if (turtle_arena_stats.bytes_live > turtle_arena_stats.bytes_peak) {
+            turtle_arena_stats.bytes_peak = turtle_arena_stats.bytes_live;
+        }
+        return memory;
+    }
+
+    void* bigger = turtle_arena_alloc(arena, new_size);
+    memcpy(bigger, memory, old_size);
+    return bigger;
+}
+
+// give back every block at once, keeping a few around for the next job
+void turtle_arena_release(struct Arena* arena) {
+    struct Arena_Block* block = arena->head;
+    while (block != NULL) {
+        struct Arena_Block* temp = block->next;
+        turtle_arena_stats.blocks_live--;
+        turtle_arena_stats.bytes_live -= block->used;
+
+        if (block->size == ARENA_BLOCK_SIZE && turtle_arena_stats.blocks_cached < ARENA_CACHE_BLOCKS) {
+            block->next = turtle_arena_free_list;
+            turtle_arena_free_list = block;
+            turtle_arena_stats.blocks_cached++;
+        } else {
+            free(block);
+            turtle_arena_stats.block_frees++;
+        }
+        block = temp;
+    }
+    arena->head = NULL;
+}
+
+// create an empty job whose arena will own everything parsed for it
+struct Job* turtle_new_job() {
+    struct Arena arena = {NULL};
+    struct Job* job = turtle_arena_alloc(&arena, sizeof(struct Job));
+    job->arena = arena;
+    job->pgid = -1;
+    return job;
+}
+
+// release a job and everything it owns in one step
+void turtle_free_job(struct Job* job) {
+    // the relays live in the arena too
+    turtle_meter_finish(job);
+
+    // nothing can find these commands by pid once they are gone
+    struct Command* cur_cmd = job->root;
+    while (cur_cmd != NULL) {
+        if (cur_cmd->pid > 0) {
+            turtle_unindex_pid(cur_cmd);
         }
         cur_cmd = cur_cmd->next;
-        if (cur_cmd != NULL) {
-            printf("|\n");
+    }
+
+    // the job itself lives in the arena, so copy the arena out before releasing it
+    struct Arena arena = job->arena;
+    turtle_arena_release(&arena);
+}
+
+// turn tracing on if TURTLE_TRACE asks for it; a value other than 1 names a file to dump to on exit
+void turtle_trace_init() {
+    turtle_trace.pid = getpid();
+    char* setting = getenv("TURTLE_TRACE");
+    if (setting == NULL || setting[0] == '\0' || strcmp(setting, "0") == 0) {
+        return;
+    }
+
+    turtle_trace_enable(1);
+    if (strcmp(setting, "1") != 0) {
+        turtle_trace.dump_path = strdup(setting);
+        atexit(turtle_trace_exit_dump);
+    }
+}
+
+void turtle_trace_enable(int enabled) {
+    if (enabled && turtle_trace.events == NULL) {
+        turtle_trace.events = calloc(TRACE_EVENTS, sizeof(struct Trace_Event));
+    }
+    turtle_trace.enabled = enabled;
+}
+
+// timestamp to start a span with, or 0 when tracing is off so the span is dropped
+uint64_t turtle_trace_begin() {
+    if (!turtle_trace.enabled) {
+        return 0;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// finish a span of the shell's own work that turtle_trace_begin started
+void turtle_trace_end(const char* name, const char* detail, uint64_t start_ns, long arg) {
+    if (start_ns == 0 || !turtle_trace.enabled) {
+        return;
+    }
+    turtle_trace_span(name, detail, start_ns, turtle_trace_begin(), turtle_trace.pid, arg);
+}
+
+// add a span to the ring, overwriting the oldest once it is full
+void turtle_trace_span(const char* name, const char* detail, uint64_t start_ns, uint64_t end_ns, int tid, long arg) {
+    uint64_t index = __atomic_fetch_add(&turtle_trace.head, 1, __ATOMIC_RELAXED);
+    struct Trace_Event* event = &turtle_trace.events[index & (TRACE_EVENTS - 1)];
+
+    // readers only trust an event whose seq reads the same before and after copying it
+    __atomic_store_n(&event->seq, 0, __ATOMIC_RELEASE);
+    event->start_ns = start_ns;
+    event->duration_ns = end_ns > start_ns ? end_ns - start_ns : 0;
+    event->tid = tid;
+    event->arg = arg;
+    if (detail != NULL) {
+        snprintf(event->name, TRACE_NAME_SIZE, "%s %s", name, detail);
+    } else {
+        snprintf(event->name, TRACE_NAME_SIZE, "%s", name);
+    }
+    __atomic_store_n(&event->seq, index + 1, __ATOMIC_RELEASE);
+}
+
+void turtle_trace_clear() {
+    __atomic_store_n(&turtle_trace.head, 0, __ATOMIC_RELAXED);
+    if (turtle_trace.events != NULL) {
+        memset(turtle_trace.events, 0, TRACE_EVENTS * sizeof(struct Trace_Event));
+    }
+}
+
+static void turtle_trace_put_name(FILE* out, const char* name) {
+    for (const char* cur = name; *cur != '\0'; cur++) {
+        if (*cur == '"' || *cur == '\\') {
+            fprintf(out, "\\%c", *cur);
+        } else if ((unsigned char) *cur < 0x20) {
+            fprintf(out, "\\u%04x", *cur);
         } else {
-            printf("\n");
+            fputc(*cur, out);
         }
     }
-    return 0;
-}
\ No newline at end of file
+}
+
+// write out every event still in the ring, oldest first, as Chrome trace JSON or one object per line
+void turtle_trace_dump(FILE* out, int jsonl) {
+    uint64_t head = __atomic_load_n(&turtle_trace.head, __ATOMIC_ACQUIRE);
+    uint64_t first = head > TRACE_EVENTS ? head - TRACE_EVENTS : 0;
+    int written = 0;
+
+    if (!jsonl) {
+        fprintf(out, "{\"traceEvents\":[\n");
+    }
+    for (uint64_t index = first; index < head && turtle_trace.events != NULL; index++) {
+        struct Trace_Event* slot = &turtle_trace.events[index & (TRACE_EVENTS - 1)];
+        struct Trace_Event event;
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != index + 1) {
+            continue;
+        }
+        memcpy(&event, slot, sizeof(event));
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != index + 1) {
+            continue;
+        }
+        event.name[TRACE_NAME_SIZE - 1] = '\0';
+
+        if (jsonl) {
+            fprintf(out, "{\"name\":\"");
+            turtle_trace_put_name(out, event.name);
+            fprintf(out, "\",\"start_ns\":%llu,\"duration_ns\":%llu,\"pid\":%d,\"tid\":%d,\"arg\":%ld}\n",
+                    (unsigned long long) event.start_ns, (unsigned long long) event.duration_ns,
+                    turtle_trace.pid, event.tid, event.arg);
+        } else {
+            fprintf(out, "%s{\"name\":\"", written > 0 ? ",\n" : "");
+            turtle_trace_put_name(out, event.name);
+            fprintf(out, "\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"arg\":%ld}}",
+                    event.start_ns / 1000.0, event.duration_ns / 1000.0, turtle_trace.pid, event.tid, event.arg);
+        }
+        written++;
+    }
+    if (!jsonl) {
+        fprintf(out, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    }
+}
+
+// write the trace to the file TURTLE_TRACE named, choosing the format from its extension
+void turtle_trace_exit_dump() {
+    // a forked child that exits inherits this handler, but the file belongs to the shell
+    if (getpid() != turtle_trace.pid) {
+        return;
+    }
+    FILE* out = fopen(turtle_trace.dump_path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "turtle: trace: could not write %s\n", turtle_trace.dump_path);
+        return;
+    }
+    size_t length = strlen(turtle_trace.dump_path);
+    int jsonl = length > 6 && strcmp(turtle_trace.dump_path + length - 6, ".jsonl") == 0;
+    turtle_trace_dump(out, jsonl);
+    fclose(out);
+}
@@ -1,37 +1,157 @@
+#define _GNU_SOURCE
+
 #include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <fnmatch.h>
 #include <glob.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
 #include <pwd.h>
 #include <signal.h>
+#include <stdint.h>
+#include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <termios.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include <sys/signalfd.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 
 #define MAX_USER_LENGTH 32
 #define MAX_PATH_LENGTH 4096
-#define MAX_NUM_JOBS 20
+#define JOBS_SIZE 16
+#define PID_INDEX_SIZE 64
 #define INPUT_SIZE 1024
+#define READ_BLOCK 65536
 #define BUFFER_SIZE 64
+#define TOKEN_SIZE 32
+#define LEX_PADDING 8
+#define SWAR_ONES 0x0101010101010101ULL
+#define SWAR_HIGHS 0x8080808080808080ULL
+#define HASH_SIZE 256
+#define GLOB_CACHE_SIZE 256
+#define GLOB_CACHE_MAX_DIRS 1024
+#define WALK_BUFFER 32768
+#define WALK_MAX_THREADS 64
+#define ARG_HEADROOM 4096
+#define SINK_SIZE 65536
+#define MOVE_CHUNK (1 << 20)     // most asked of the kernel in one splice, sendfile or copy_file_range
+#define MOVE_BUFFER 65536
+#define HISTORY_RING 256
+#define HISTORY_LIST 16         // commands history shows when not told how many
+#define HISTORY_MATCHES 20      // matches history search shows
+#define SHARED_HISTORY_SIZE (1 << 20)   // bytes of commands the shared segment holds before wrapping
+#define SHARED_HISTORY_MAGIC 0x7475727468697374ULL
+#define SHARED_HISTORY_PAD 0xffffffffU   // record length marking room skipped at the end of the ring
+#define SHARED_HISTORY_ALIGN 32          // records are a multiple of this, at least a header
+#define SHARED_HISTORY_STALL 5           // seconds a record may stay unfinished before it is given up on
+#define HISTORY_SCAN_BUDGET 1024 // newest commands searched directly before turning to the index
+#define PIPE_DEFAULT_SIZE 65536
+#define PIPE_MIN_SIZE 4096
+#define METER_GROW_AFTER 8      // drains in a row that find the pipe three quarters full before it doubles
+#define METER_SHRINK_AFTER 256  // drains in a row that find it nearly empty before it halves
+#define TRACE_EVENTS 65536      // must be a power of two
+#define TRACE_NAME_SIZE 48
+#define ARENA_BLOCK_SIZE 4096
+#define ARENA_ALIGN 16
+#define ARENA_CACHE_BLOCKS 64
+#define COMPLETE_LIST 200       // matches kept to list when tab is pressed twice
+#define COMPLETE_READ 32768     // directory bytes read between checks for a key press
+#define SEARCH_LENGTH 256       // longest text ctrl-r searches history for
+#define PROMPT_EXTRA 512        // room in the prompt beyond the directory
+#define PROMPT_BRANCH_LENGTH 128
+#define PROMPT_TIMEOUT_MS 20    // how long a prompt waits on its background segments by default
 
 // signal handlers
-struct sigaction act_int;
+extern struct sigaction act_int;
+
+// message about a background job that finished
+struct Notice {
+    char* text;
+    struct Notice* next;
+};
 
 // shell attributes for current shell information
 struct shell_info {
+    int interactive;            // whether we own a terminal or are running a batch of commands
     char user[MAX_USER_LENGTH];
     char dir[MAX_PATH_LENGTH];
     char pw_dir[MAX_PATH_LENGTH];
-    struct Job* jobs[MAX_NUM_JOBS];
+    struct Job** jobs;          // job table indexed by job id, grown as needed
+    int jobs_size;              // slots allocated in jobs
+    int jobs_count;             // jobs currently in the table
+    int jobs_free;              // lowest id that may be free
+    struct Command** pid_index; // buckets of commands chained by pid
+    int pid_index_size;         // number of buckets, always a power of two
+    int pid_count;              // commands currently in the index
+    int child_fd;               // signalfd that becomes readable on SIGCHLD
+    struct Notice* notices;     // finished background jobs to report at the next prompt
+    int sched_enabled;          // whether background jobs go through the scheduler
+    int sched_max;              // background jobs allowed to run at once, 0 for no limit
+    int sched_running;          // scheduled background jobs currently running
+    int sched_queued;           // background jobs waiting for a slot
+    int sched_dispatching;      // set while queued jobs are being started
+    struct Job* sched_head;     // oldest queued job, started first
+    struct Job* sched_tail;     // newest queued job
+    int autobatch;              // split commands whose wildcards expand past ARG_MAX into batches
+    int pipe_max;               // largest pipe capacity we may ask for, from /proc/sys/fs/pipe-max-size
+    int last_status;            // exit status of the last foreground command, what exit and a batch end with
+    struct Job* current_job;    // job whose commands are being started, which jobs leaves out
 };
-struct shell_info* shell;
+extern struct shell_info* shell;
+
+// chunk of memory handed out piece by piece by an arena
+struct Arena_Block {
+    struct Arena_Block* next;   // block filled before this one
+    size_t size;                // usable bytes in data
+    size_t used;                // bytes of data already handed out
+    char data[];
+};
+
+// owns a group of allocations so they can all be released at once
+struct Arena {
+    struct Arena_Block* head;   // block currently being filled
+};
+
+// counters to check that memory stays flat over long sessions
+struct Arena_Stats {
+    long allocations;           // allocations handed out by any arena
+    long blocks_live;           // blocks currently owned by arenas
+    long blocks_cached;         // released blocks kept for reuse
+    long block_mallocs;         // blocks ever taken from malloc
+    long block_frees;           // blocks ever given back to free
+    long long bytes_live;       // bytes handed out and not yet released
+    long long bytes_peak;       // most bytes ever live at once
+};
+
+extern struct Arena_Block* turtle_arena_free_list;
+extern struct Arena_Stats turtle_arena_stats;
 
 // information related to a command
-enum command_type{EXIT, CD, JOBS, FG, BG, KILL, UNSET, EXTERNAL, HISTORY, THEME, HELP, TURTLESAY};
-enum status{RUNNING, DONE, SUSPENDED, CONTINUED, TERMINATED};
+enum command_type{EXIT, CD, JOBS, FG, BG, KILL, UNSET, EXTERNAL, HISTORY, THEME, HELP, TURTLESAY, HASH, ENGINE, ARENA, SCHED, PARALLEL, GLOBCACHE, BATCH, AUTOBATCH, TRACE, PROMPT,
+                  // utilities common enough in scripts to be worth running inside the shell
+                  ECHO_UTIL, PRINTF_UTIL, TEST_UTIL, TRUE_UTIL, FALSE_UTIL, PWD_UTIL,
+                  // utilities that move data between fds rather than print it
+                  CAT_MOVER, TEE_MOVER};
+struct Builtin {
+    const char* name;
+    enum command_type type;
+};
+extern const struct Builtin turtle_builtins[];
+enum status{RUNNING, DONE, SUSPENDED, CONTINUED, TERMINATED, QUEUED};
 struct Command {
     int argc;                   // number of arguments
     enum command_type cmd_type; // type of the command
@@ -40,41 +160,565 @@ struct Command {
     char* input_path;           // where the command is reading input from
     char* output_path;          // where the command is writing output to
     enum status status_type;    // status for the command
+    int exit_code;              // exit status, or 128 plus the signal that ended it
+    char* deferred;             // for batch commands, marks the arguments that are patterns still to expand
+    struct timespec start_time; // when the command was started
+    struct timespec end_time;   // when it finished
+    struct rusage usage;        // cpu time, memory and context switches it used
     struct Command *next;       // any commands that follow
+    struct Job* job;            // job this command belongs to
+    struct Command* pid_next;   // next command in the same pid index bucket
+};
+
+// pieces of a command line produced by the lexer
+enum token_type{WORD, PIPE, REDIRECT_IN, REDIRECT_OUT, AMPERSAND};
+#define TOKEN_QUOTED 1          // word had quotes or escapes in it
+#define TOKEN_GLOB 2            // word has an unquoted * or ?
+#define TOKEN_VARIABLE 4        // word starts with an unquoted $
+struct Token {
+    enum token_type type;
+    int flags;                  // TOKEN_* bits for words
+    char* text;                 // unquoted word, pointing into the job's line
+    char* quoted;               // nonzero for each byte of text that is a quoted * ? [ or \, or NULL if none are
 };
 
 // information related to a job
 enum mode{FOREGROUND, BACKGROUND, PIPELINE};
 struct Job {
     int id;
+    struct Arena arena;         // owns the job, its commands, and their strings
+    char* line;                 // copy of the input the commands point into
     struct Command *root;
     pid_t pgid;
     enum mode mode_type;
+    int scheduled;              // holds one of the scheduler's slots
+    int queued;                 // waiting in the scheduler's queue
+    struct Job* queue_next;     // next job in the queue
+    int waited;                 // a builtin is waiting on this job, so the reaper leaves it alone
+    int timed;                  // report what each command used once the job finishes
+    int metered;                // count what goes through each pipe and size the pipes to fit
+    int pipe_size;              // capacity asked for with pipesize, 0 for the default
+    struct Pipe_Meter* meters;  // one per pipe of a metered job, in pipeline order
+};
+
+// relays one pipe of a metered job into the next, counting the bytes and growing
+// both pipes while the writer keeps filling them
+struct Pipe_Meter {
+    int link;                   // which pipe of the job, counting from 1
+    int in_fd;                  // read end of the pipe the stage before writes to
+    int out_fd;                 // write end of the pipe the stage after reads from
+    int capacity;               // current capacity of both pipes
+    int floor;                  // capacity the pipes started with, never shrunk below
+    int peak_fill;              // most bytes ever seen waiting in the pipe
+    int resizes;                // times the capacity was changed
+    long bytes;                 // bytes relayed so far, updated while the relay runs
+    int done;                   // the relay saw the writer or the reader finish
+    int joined;
+    struct timespec start;
+    struct timespec end;
+    pthread_t thread;
+    struct Pipe_Meter* next;
+};
+
+// command of a pool that is running, with where its output is being held
+struct Pool_Slot {
+    struct Command* cmd;
+    int out_fd;                 // where the command writes, a memfd while its output is held back
+};
+
+// runs the independent commands of one job, a limited number at a time
+struct Pool {
+    struct Job* job;
+    int max_running;            // commands allowed to run at once
+    int running;                // commands running right now
+    int group_output;           // hold each command's output until it finishes
+    int in_fd;                  // what every command reads
+    int out_fd;                 // where output goes when it is not held back
+    int interrupted;            // ctrl-c was pressed, so start nothing new
+    struct Pool_Slot* slots;    // one per command that may run at once
 };
 
-// struct to keep track of list of commands
+// ways of moving data between two fds, cheapest first
+enum move_method{MOVE_COPY_RANGE, MOVE_SPLICE, MOVE_SENDFILE, MOVE_READ_WRITE};
+
+// buffered writer that builtins and utilities print through, bound to one fd
+struct Sink {
+    int fd;                     // where the output goes
+    int hold;                   // keep everything until the end, since nothing reads the pipe yet
+    char* buffer;               // output not yet written
+    size_t used;
+    size_t size;
+    FILE* file;                 // stdio stream that writes into the sink
+};
+
+// splits a command's expanded arguments into runs that each fit in one exec
+struct Batch {
+    struct Pool pool;           // runs the batches, one at a time unless asked for more
+    struct Command* cmd;        // command being split up
+    char* exec_path;            // program every batch runs
+    int start;                  // index of the program in cmd->argv, after any batch options
+    int first;                  // arguments before this one start every batch
+    int last;                   // arguments after this one end every batch
+    long limit;                 // bytes left for the arguments in between
+    char* strings;              // arguments gathered for the next batch
+    long strings_used;
+    long strings_size;
+    int chunk_count;            // arguments in strings
+    long chunk_bytes;           // space they will take in exec
+    struct Command* tail;       // newest batch started
+    struct Command* reclaim;    // oldest batch whose arguments have not been freed
+};
+
+// command history: the newest commands are kept in a ring, and every command ever entered is
+// appended to a history file that is mapped in and indexed by where each command starts
 struct History {
-    struct History* turtle_next;
-    char* history_command;
+    int fd;                     // history file, opened to append
+    char* map;                  // the file mapped in, for commands that have left the ring
+    size_t map_size;
+    off_t* offsets;             // where each command starts in the file, by number less one
+    long count;                 // commands numbered so far
+    long size;                  // room in offsets
+    char* ring[HISTORY_RING];   // newest commands, command n in slot n % HISTORY_RING
+    size_t ring_length[HISTORY_RING];
+    off_t file_start;           // size of the history file when it was read in
+    struct Shared_History* shared;  // segment other sessions publish their commands to, if sharing
+    uint64_t shared_tail;       // how far into the segment this session has read
+    time_t shared_stalled;      // when the record at shared_tail was first found unfinished
+};
+
+// segment mapped by every session that shares history, with commands laid down one after
+// another in a ring; space is reserved with a single fetch_add, so no session ever takes a lock
+struct Shared_History {
+    uint64_t magic;
+    uint64_t head;              // bytes ever reserved, the position of the next record
+    char padding[48];           // keep head on a cache line of its own
+    char data[SHARED_HISTORY_SIZE];
+};
+
+// one command in the shared segment, padded to SHARED_HISTORY_ALIGN bytes
+struct Shared_Record {
+    uint64_t seq;               // position of the record plus one, stored once the rest is in place
+    uint32_t length;            // bytes of text, or SHARED_HISTORY_PAD
+    int32_t pid;                // session that entered it
+    int64_t offset;             // where it starts in the history file, -1 if it could not be saved,
+                                // or for padding, how many bytes it covers
+    char text[];
+};
+
+extern struct History turtle_history_log;
+
+// a distinct command of the history; entering it again only moves it up
+struct History_Unique {
+    uint64_t hash;              // hash of its text
+    long last;                  // number of the newest time it was entered
+};
+
+// every distinct command whose text contains one trigram, in the order they were first entered
+struct Trigram_List {
+    uint32_t key;               // the three bytes plus one, so 0 marks an empty slot
+    uint32_t count;
+    uint32_t size;
+    uint32_t* ids;              // ids of the commands, always increasing
+};
+
+// trigram index over the distinct commands of the history, built the first time it is
+// searched and kept up to date as commands are entered from then on
+struct History_Index {
+    int built;
+    struct History_Unique* unique;  // distinct commands by id
+    long unique_count;
+    long unique_size;
+    long* unique_table;         // open addressed table of id plus one, by hash of text
+    long unique_table_size;     // always a power of two
+    struct Trigram_List* lists; // open addressed table of lists, by trigram
+    long list_count;
+    long list_table_size;       // always a power of two
+};
+
+extern struct History_Index turtle_history_index;
+
+// buffered input shared by every prompt
+struct Input_Reader {
+    int fd;                     // where commands are read from
+    char* block;                // raw bytes read but not yet consumed
+    size_t block_start;         // first unconsumed byte in block
+    size_t block_end;           // one past the last byte read into block
+    char* line;                 // line being assembled, reused across prompts
+    size_t line_size;           // bytes allocated for line
+    size_t line_length;         // bytes currently in line
+    const char* prompt;         // shown before the next line is read, NULL for none
+};
+
+extern struct Input_Reader turtle_input;
+
+// keys the line editor tells apart, beyond the bytes it is sent
+enum edit_key{EDIT_NONE = -3, EDIT_EOF = -2, EDIT_INTERRUPT = -1,
+              EDIT_LEFT = 256, EDIT_RIGHT, EDIT_UP, EDIT_DOWN, EDIT_HOME, EDIT_END, EDIT_DELETE,
+              EDIT_ALT = 512};    // alt or escape followed by a byte, added to that byte
+enum complete_kind{COMPLETE_COMMAND, COMPLETE_PATH, COMPLETE_VARIABLE};
+
+// one letter in the trie of command names, whose siblings are kept in order
+struct Trie_Node {
+    struct Trie_Node* child;    // first letter that can follow this one
+    struct Trie_Node* sibling;  // next letter that can stand in this one's place
+    char letter;
+    char end;                   // whether a name ends here
+};
+
+// every executable on $PATH and every builtin, rebuilt when PATH or one of its directories changes
+struct Command_Trie {
+    struct Arena arena;         // owns every node
+    struct Trie_Node* root;
+    char* path;                 // $PATH the trie was built from
+    struct timespec* mtimes;    // when each of its directories last changed, as of the build
+    int dirs;                   // directories in path
+    long names;                 // names in the trie
+};
+
+// what tab found for the word under the cursor
+struct Completion {
+    enum complete_kind kind;
+    char* names[COMPLETE_LIST]; // the first matches found, kept to list
+    char dirs[COMPLETE_LIST];   // whether each of them is a directory
+    long count;                 // matches found in all
+    char* common;               // longest prefix every match shares
+    size_t common_length;
+    size_t typed;               // bytes of each match the word already has
+    int aborted;                // a key was pressed before the directory was read through
+};
+
+// state of the raw mode line editor used when reading from a terminal
+struct Line_Editor {
+    int enabled;                // whether input comes from a terminal we can put in raw mode
+    struct termios cooked;      // terminal settings to hand back to commands
+    struct termios raw;         // settings while a line is edited
+    const char* prompt;         // prompt the line is being typed after
+    int prompt_width;           // columns the prompt takes on screen
+    size_t start;               // where this line begins in the input line, past any it continues
+    size_t cursor;              // bytes of the line before the cursor
+    size_t scroll;              // bytes of the line scrolled off the left edge
+    char* screen;               // what one redraw writes
+    size_t screen_size;
+    char* kill;                 // text last cut, for ctrl-y
+    size_t kill_length;
+    long recall;                // history number shown by up and down, 0 for the line being typed
+    char* draft;                // the line being typed while history is shown
+    int tabs;                   // tabs pressed in a row
+    struct Command_Trie commands;
+};
+
+extern struct Line_Editor turtle_editor;
+
+// pieces the prompt can be made of; the ones after dir are worked out on a background thread
+enum prompt_segment{PROMPT_USER, PROMPT_DIR, PROMPT_BRANCH, PROMPT_DURATION, PROMPT_LOAD, NUM_PROMPT_SEGMENTS};
+
+// the prompt is kept built between commands, and only the parts that can change are redone
+struct Prompt {
+    int enabled[NUM_PROMPT_SEGMENTS];
+    int colors[3];              // theme colours the cached text was built with
+    int stale;                  // set by cd and the prompt builtin when the cached text is out of date
+    char user[MAX_USER_LENGTH]; // LOGNAME, read once
+    char text[MAX_PATH_LENGTH + PROMPT_EXTRA];
+    size_t fixed_length;        // bytes of text that only change with the theme or the directory
+    double duration;            // seconds the last command took
+    int timeout_ms;             // longest a prompt waits for its background segments
+    int started;                // whether the background thread is running
+    pthread_t thread;
+    pthread_mutex_t lock;       // guards everything below
+    pthread_cond_t wake;        // signalled when there is a directory to look at
+    pthread_cond_t done;        // signalled when a look is finished
+    int busy;                   // a look is under way, perhaps stuck on a slow filesystem
+    long asked;                 // looks asked for
+    long answered;              // looks finished
+    int want_branch;            // which segments the thread should work out
+    int want_load;
+    char ask_dir[MAX_PATH_LENGTH];
+    char branch[PROMPT_BRANCH_LENGTH];
+    char branch_dir[MAX_PATH_LENGTH]; // directory the branch was found for
+    double load;                // one minute load average, negative if unknown
+};
+
+extern struct Prompt turtle_prompt;
+extern const char* turtle_prompt_names[NUM_PROMPT_SEGMENTS];
+
+// remembered location of an external command, keyed by its name
+struct Hash_Entry {
+    char* name;                 // command name as typed
+    char* path;                 // full path found on $PATH
+    int hits;                   // number of times the command was looked up to be run
+    struct Hash_Entry* next;    // next entry in the same bucket
+};
+
+extern struct Hash_Entry* turtle_hash_table[HASH_SIZE];
+
+// arguments of a command while it is being parsed
+struct Arg_List {
+    struct Arena* arena;        // where the list lives
+    char** args;                // arguments so far, with room for a terminating NULL
+    int count;                  // arguments in args
+    int size;                   // slots allocated for args
+    long bytes;                 // space the arguments take in exec, counted only with a limit
+    long limit;                 // stop expanding wildcards past this many bytes, 0 for no limit
+    char* deferred;             // when not NULL, marks the arguments that are patterns left to expand
+};
+
+// one name read from a directory
+struct Dir_Name {
+    char* name;
+    unsigned char type;         // DT_* type from the directory, DT_UNKNOWN if it did not say
+};
+
+// remembered listing of a directory, reused until the directory changes
+struct Dir_Entry {
+    dev_t dev;                  // device and inode identify the directory however it is reached
+    ino_t ino;
+    struct timespec mtime;      // times the listing was taken against
+    struct timespec ctime;
+    int racy;                   // listed too soon after a change for the times to be trusted
+    struct Dir_Name* names;     // names sorted with strcmp
+    int count;                  // number of names
+    char* pool;                 // storage for the names
+    int pins;                   // walks still going through names, which keep it from being freed
+    int dropped;                // no longer in the cache, freed once the last pin is gone
+    struct Dir_Entry* next;     // next entry in the same bucket
+};
+
+struct Glob_Stats {
+    long hits;                  // listings served from the cache
+    long misses;                // listings read from the disk
+    long dirs_cached;           // directories in the cache
+    long names_cached;          // names held by those directories
+};
+
+// state of one pattern expansion
+struct Glob_Walk {
+    int (*each)(const char* path, void* data);
+    void* data;
+    int count;                  // matches found
+    int stopped;                // each asked for no more matches
+    int sorted;                 // matches come out already in order, so they need not be collected
+    char** matches;             // collected matches when they need sorting
+    int matches_size;
+    char path[MAX_PATH_LENGTH]; // path built up so far
+};
+
+// directory waiting to be read by the tree walker
+struct Walk_Dir {
+    char* path;                 // relative to the root of the walk, "" for the root itself
+    int depth;                  // number of parts in path
+};
+
+// directories one walker thread has found, which other threads may steal
+struct Walk_Queue {
+    pthread_mutex_t lock;
+    struct Walk_Dir* dirs;
+    int head;                   // oldest directory, taken by thieves
+    int tail;                   // newest directory, taken by the owner
+    int size;                   // slots allocated for dirs
+};
+
+// a walker thread and the matches it found
+struct Walk_Worker {
+    struct Tree_Walk* tree;
+    int id;                     // which queue belongs to this thread
+    char** matches;             // matching paths relative to the root
+    int count;
+    int size;
+};
+
+// state shared by the threads walking one tree for **
+struct Tree_Walk {
+    int root_fd;                // directory the ** started in
+    char* pattern;              // what the last parts of a path must match, NULL for anything
+    int parts;                  // number of parts in pattern
+    int want_dir;               // only directories match
+    int workers;                // number of walker threads
+    struct Walk_Queue* queues;  // one per walker thread
+    long pending;               // directories queued or being read
+    pthread_mutex_t idle_lock;  // held to decide to sleep, and to wake the sleepers
+    pthread_cond_t idle_cond;   // signalled when a directory is queued or the walk is over
+    int idle;                   // threads asleep waiting for a directory
+};
+
+// one timed span recorded by the tracer
+struct Trace_Event {
+    uint64_t seq;               // index plus one once the event is complete, so half-written ones are skipped
+    uint64_t start_ns;          // CLOCK_MONOTONIC
+    uint64_t duration_ns;
+    int tid;                    // the shell, or the pid of a child
+    long arg;                   // pid, job id, exit status or count, depending on the span
+    char name[TRACE_NAME_SIZE];
+};
+
+// fixed ring of trace events that any thread can add to without a lock
+struct Trace_Ring {
+    int enabled;
+    struct Trace_Event* events; // TRACE_EVENTS of them, allocated when tracing is first turned on
+    uint64_t head;              // events ever claimed
+    pid_t pid;                  // the shell, which every event is filed under
+    char* dump_path;            // where to write the trace on exit, from TURTLE_TRACE
+};
+
+extern struct Dir_Entry* turtle_glob_cache[GLOB_CACHE_SIZE];
+extern struct Glob_Stats turtle_glob_stats;
+extern struct Trace_Ring turtle_trace;
+
+// ways of starting an external command
+enum engine{FORK_ENGINE, VFORK_ENGINE, SPAWN_ENGINE, NUM_ENGINES};
+struct Engine_Stats {
+    long launches;              // number of commands started with this engine
+    long long total_ns;         // total time spent starting them
 };
 
-struct History* turtle_head;
+extern enum engine turtle_engine;
+extern struct Engine_Stats turtle_engine_stats[NUM_ENGINES];
+extern char** environ;
 
 // list of methods
-void turtle_init();
+void turtle_init(int interactive);
 void sigint_handler(int signal);
 void turtle_welcome();
 void turtle_run();
 char* turtle_read();
+void turtle_grow_line(size_t extra);
+char* turtle_read_line();
+int turtle_wait_input(int fd);
+void turtle_editor_init();
+int turtle_edit_byte();
+int turtle_edit_key();
+int turtle_edit_width(const char* text, size_t length);
+void turtle_edit_refresh();
+void turtle_edit_redraw();
+void turtle_edit_insert(const char* text, size_t length);
+void turtle_edit_delete(size_t from, size_t to);
+void turtle_edit_kill(size_t from, size_t to);
+void turtle_edit_replace(const char* text, size_t length);
+void turtle_edit_recall(long number);
+int turtle_edit_search();
+char* turtle_edit_line();
+void turtle_edit_complete();
+int turtle_complete_in_command(const char* text, size_t at);
+void turtle_complete(const char* word, enum complete_kind kind, struct Completion* found);
+void turtle_complete_add(struct Completion* found, const char* name, size_t length, int dir);
+void turtle_complete_free(struct Completion* found);
+void turtle_complete_list(struct Completion* found);
+void turtle_complete_paths(const char* word, struct Completion* found);
+void turtle_complete_commands(const char* word, struct Completion* found);
+void turtle_commands_refresh();
+void turtle_commands_insert(const char* name);
+const char* turtle_prompt_render();
+void turtle_prompt_collect(char* branch, double* load);
+void* turtle_prompt_worker(void* arg);
+void turtle_prompt_find_branch(const char* dir, char* branch);
+void turtle_commands_walk(struct Trie_Node* node, char* name, size_t length, struct Completion* found);
+void turtle_read_string(char* command);
+uint64_t turtle_swar_special(uint64_t chunk);
+struct Token* turtle_add_token(struct Job* job, struct Token** tokens, int* count, int* capacity);
+int turtle_lex(struct Job* job, char* line, struct Token** tokens);
 struct Job* turtle_parse(char* input);
-struct Command* turtle_parse_single(char* command);
+struct Command* turtle_parse_single(struct Job* job, struct Token* tokens, int count);
+int turtle_parse_args(struct Token* tokens, int count, struct Arg_List* list, char** input_path, char** output_path);
+void turtle_add_arg(struct Arg_List* list, char* arg);
+int turtle_add_glob_match(const char* path, void* data);
+long turtle_arg_limit();
+long turtle_arg_bytes(char** argv);
 enum command_type turtle_get_cmd_type(char* command);
 int turtle_execute(struct Job* job);
+int turtle_run_job(struct Job* job, int* exec_ret);
+int turtle_sched_admit(struct Job* job);
+void turtle_sched_unqueue(struct Job* job);
+void turtle_sched_dispatch();
+int turtle_sched_live();
+void turtle_sched_drain();
+void turtle_history_init();
+void turtle_history_add(const char* text, size_t length);
+void turtle_history_keep(const char* text, size_t length, off_t offset);
+void turtle_history_share(const char* path);
+void turtle_history_publish(const char* text, size_t length, off_t offset);
+void turtle_history_sync();
+const char* turtle_history_get(long number, size_t* length);
+long turtle_history_find(const char* prefix, size_t length);
+char* turtle_history_expand(const char* line);
+void turtle_history_index_add(long number, const char* text, size_t length);
+void turtle_history_index_build();
+long turtle_history_search(const char* text, long* results, long max);
+int turtle_make_link(struct Job* job, int link, int fd[2]);
+void* turtle_meter_relay(void* arg);
+void turtle_meter_finish(struct Job* job);
+void turtle_print_meters(FILE* out, struct Job* job);
+int turtle_parse_pipe_size(const char* text);
 int turtle_insert_job(struct Job* job);
+struct Job* turtle_get_job(int id);
 int turtle_remove_job(int id);
 int turtle_remove_process(int pid);
 int turtle_print_process(int id);
+int turtle_execute_builtin(struct Command* cmd, int in_fd, int out_fd);
+void turtle_close_fds(int in_fd, int out_fd);
+int turtle_is_utility(enum command_type cmd_type);
+int turtle_run_utility(struct Command* cmd, FILE* out);
+FILE* turtle_sink_open(struct Sink* sink, int fd, int hold);
+void turtle_sink_flush(struct Sink* sink, const char* extra, size_t extra_length);
+void turtle_sink_finish(struct Job* job, struct Command* cmd, struct Sink* sink);
+int turtle_is_mover(enum command_type cmd_type);
+int turtle_mover_plain(enum command_type cmd_type, char** argv);
+int turtle_run_mover(struct Command* cmd, int in_fd, int out_fd);
+int turtle_write_all(int fd, const char* data, size_t length);
+enum move_method turtle_move_method(int in_fd, int out_fd);
+ssize_t turtle_move(int in_fd, int out_fd);
+ssize_t turtle_fan_out(int in_fd, int* out_fds, int count);
+int turtle_wait_foreground(struct Job* job, enum mode mode_type);
 int turtle_execute_single(struct Job* job, struct Command* cmd, int in_fd, int out_fd, enum mode mode_type);
+pid_t turtle_launch(struct Job* job, struct Command* cmd, char* exec_path, int in_fd, int out_fd);
+pid_t turtle_launch_fork(struct Job* job, struct Command* cmd, char* exec_path, int in_fd, int out_fd);
+pid_t turtle_launch_vfork(struct Job* job, struct Command* cmd, char* exec_path, int in_fd, int out_fd);
+pid_t turtle_launch_spawn(struct Job* job, struct Command* cmd, char* exec_path, int in_fd, int out_fd);
+void turtle_script_argv(struct Command* cmd, char* exec_path, char** sh_argv);
+int turtle_exec_status(int error);
 int turtle_wait_job(int id);
-int turtle_set_status(int pid, enum status status);
-int turtle_print_job_status(int id);
\ No newline at end of file
+void turtle_check_children();
+void turtle_reap_children();
+struct Command* turtle_child_changed(pid_t pid, int status, struct rusage* usage);
+void turtle_record_status(struct Command* cmd, int status, struct rusage* usage);
+void turtle_account_start(struct Command* cmd, struct rusage* before);
+void turtle_account_end(struct Command* cmd, struct rusage* before);
+double turtle_seconds(struct timespec* start, struct timespec* end);
+void turtle_print_stage_usage(FILE* out, struct Command* cmd);
+void turtle_print_usage(FILE* out, struct Job* job);
+void turtle_pool_init(struct Pool* pool, struct Job* job, int max_running, int group_output, int in_fd, int out_fd);
+int turtle_pool_submit(struct Pool* pool, struct Command* cmd, char* exec_path);
+int turtle_pool_wait(struct Pool* pool);
+void turtle_pool_finish(struct Pool* pool);
+int turtle_job_finished(struct Job* job);
+void turtle_add_notice(struct Job* job);
+void turtle_print_notices();
+void turtle_index_pid(struct Command* cmd);
+void turtle_unindex_pid(struct Command* cmd);
+struct Command* turtle_find_pid(pid_t pid);
+int turtle_print_job_status(int id, int long_format);
+void turtle_lex_quoted(struct Job* job, struct Token* token, char* from, char* to, char* r);
+char* turtle_glob_pattern(struct Arena* arena, struct Token* token);
+void turtle_glob_literal(char* pattern);
+char* turtle_hash_lookup(char* name);
+char* turtle_hash_find(char* name, int hit);
+void turtle_hash_clear();
+struct Dir_Entry* turtle_glob_dir(const char* path);
+int turtle_glob_each(const char* pattern, int (*each)(const char* path, void* data), void* data);
+void turtle_glob_clear();
+void turtle_glob_unpin(struct Dir_Entry* entry);
+void turtle_glob_tree(struct Glob_Walk* walk, size_t length, const char* rest);
+void* turtle_walk_worker(void* arg);
+struct Arena_Block* turtle_arena_new_block(size_t size);
+void* turtle_arena_alloc(struct Arena* arena, size_t size);
+char* turtle_arena_strdup(struct Arena* arena, const char* string);
+void* turtle_arena_grow(struct Arena* arena, void* memory, size_t old_size, size_t new_size);
+void turtle_arena_release(struct Arena* arena);
+void turtle_trace_init();
+void turtle_trace_enable(int enabled);
+uint64_t turtle_trace_begin();
+void turtle_trace_end(const char* name, const char* detail, uint64_t start_ns, long arg);
+void turtle_trace_span(const char* name, const char* detail, uint64_t start_ns, uint64_t end_ns, int tid, long arg);
+void turtle_trace_clear();
+void turtle_trace_dump(FILE* out, int jsonl);
+void turtle_trace_exit_dump();
+struct Job* turtle_new_job();
+void turtle_free_job(struct Job* job);